@@ -368,20 +368,14 @@ QDBusArgument &operator<<( QDBusArgument &arg, const Akonadi::NotificationMessag
   arg << msg.sessionId();
   arg << static_cast<int>( msg.type() );
   arg << static_cast<int>( msg.operation() );
-  arg << msg.entities().values();
+  NotificationMessageHelpers::marshallEntities( arg, msg.entities() );
   arg << msg.resource();
   arg << msg.destinationResource();
   arg << msg.parentCollection();
   arg << msg.parentDestCollection();
-
-  QStringList itemParts;
-  Q_FOREACH ( const QByteArray &itemPart, msg.itemParts() ) {
-    itemParts.append( QString::fromLatin1( itemPart ) );
-  }
-  arg << itemParts;
-
-  arg << msg.addedFlags().toList();
-  arg << msg.removedFlags().toList();
+  NotificationMessageHelpers::marshallParts( arg, msg.itemParts() );
+  NotificationMessageHelpers::marshallSet( arg, msg.addedFlags() );
+  NotificationMessageHelpers::marshallSet( arg, msg.removedFlags() );
 
   arg.endStructure();
   return arg;
@@ -40,6 +40,7 @@ namespace Server
 {
 class NotificationCollector;
 class NotificationSource;
+class NotificationManager;
 }
 
 /**
@@ -170,6 +171,7 @@ class AKONADIPROTOCOLINTERNALS_EXPORT NotificationMessageV2
     // Grant access to the d-pointer
     friend class Server::NotificationCollector;
     friend class Server::NotificationSource;
+    friend class Server::NotificationManager;
 };
 
 } // namespace Akonadi
@@ -22,6 +22,12 @@
 
 #include "notificationmessagev2_p.h"
 
+#include <QtCore/QHash>
+#include <QtCore/QPair>
+
+#include <QtDBus/QDBusArgument>
+#include <QtDBus/QDBusMetaType>
+
 namespace Akonadi
 {
 
@@ -79,6 +85,40 @@ class NotificationMessageV2::Private : public QSharedData
 class NotificationMessageHelpers
 {
   public:
+    /**
+     * Marshalling helpers, writing the containers of a notification directly
+     * instead of converting them to lists first. The D-Bus signatures are the
+     * same as those of the converted lists.
+     */
+    static void marshallEntities( QDBusArgument &arg, const QMap<NotificationMessageV2::Id, NotificationMessageV2::Entity> &entities )
+    {
+      arg.beginArray( qMetaTypeId<NotificationMessageV2::Entity>() );
+      QMap<NotificationMessageV2::Id, NotificationMessageV2::Entity>::const_iterator it = entities.constBegin();
+      for ( ; it != entities.constEnd(); ++it ) {
+        ::operator<<( arg, it.value() );
+      }
+      arg.endArray();
+    }
+
+    static void marshallParts( QDBusArgument &arg, const QSet<QByteArray> &parts )
+    {
+      arg.beginArray( QVariant::String );
+      Q_FOREACH ( const QByteArray &part, parts ) {
+        arg << QString::fromLatin1( part );
+      }
+      arg.endArray();
+    }
+
+    template<typename T>
+    static void marshallSet( QDBusArgument &arg, const QSet<T> &set )
+    {
+      arg.beginArray( qMetaTypeId<T>() );
+      Q_FOREACH ( const T &value, set ) {
+        arg << value;
+      }
+      arg.endArray();
+    }
+
     template<typename T>
     static bool compareWithoutOpAndParts( const T &left, const T &right )
     {
@@ -131,6 +171,169 @@ class NotificationMessageHelpers
     }
 };
 
+/**
+ * Collects a batch of notifications and compresses them while they are
+ * appended, without limiting the search to the last few notifications.
+ *
+ * For every item and collection, the index of the last notification
+ * involving it is kept, so a new notification is only compared with the
+ * notification that was appended for the same entities last:
+ *   - Modify notifications are merged, their parts are united
+ *   - Modify and ModifyFlags notifications following an Add are dropped
+ *   - ModifyFlags notifications are merged, with later changes winning
+ *   - an item Remove following its Add drops both notifications
+ * Notifications with different session, resource or parent collections are
+ * never merged.
+ */
+template<typename Msg>
+class NotificationMessageCompressor
+{
+  public:
+    typedef QVector<Msg> List;
+
+    NotificationMessageCompressor()
+      : mDropped( 0 )
+    {
+    }
+
+    /**
+     * Appends @p msg to the batch. Returns @c false if it has been merged
+     * with a pending notification instead.
+     */
+    bool append( const Msg &msg )
+    {
+      const int previous = previousIndex( msg );
+      if ( previous >= 0 && NotificationMessageHelpers::compareWithoutOpAndParts( msg, mNotifications.at( previous ) ) ) {
+        if ( merge( mNotifications[previous], msg ) ) {
+          return false;
+        }
+      }
+
+      const int index = mNotifications.count();
+      mNotifications.append( msg );
+      if ( msg.type() == NotificationMessageV2::Items || msg.type() == NotificationMessageV2::Collections ) {
+        const QMap<NotificationMessageV2::Id, NotificationMessageV2::Entity> entities = msg.entities();
+        QMap<NotificationMessageV2::Id, NotificationMessageV2::Entity>::const_iterator it = entities.constBegin();
+        for ( ; it != entities.constEnd(); ++it ) {
+          mLastIndex.insert( EntityKey( msg.type(), it.key() ), index );
+        }
+      }
+      return true;
+    }
+
+    bool isEmpty() const
+    {
+      return mNotifications.count() == mDropped;
+    }
+
+    int count() const
+    {
+      return mNotifications.count() - mDropped;
+    }
+
+    /**
+     * Returns the compressed batch and starts a new one.
+     */
+    List takeNotifications()
+    {
+      List notifications;
+      if ( mDropped == 0 ) {
+        notifications = mNotifications;
+      } else {
+        notifications.reserve( mNotifications.count() - mDropped );
+        Q_FOREACH ( const Msg &msg, mNotifications ) {
+          if ( msg.type() != NotificationMessageV2::InvalidType ) {
+            notifications.append( msg );
+          }
+        }
+      }
+      clear();
+      return notifications;
+    }
+
+    void clear()
+    {
+      mNotifications.clear();
+      mLastIndex.clear();
+      mDropped = 0;
+    }
+
+  private:
+    typedef QPair<int, NotificationMessageV2::Id> EntityKey;
+
+    /**
+     * Returns the index of the last notification involving all entities
+     * of @p msg, or -1 if there is none.
+     */
+    int previousIndex( const Msg &msg ) const
+    {
+      if ( msg.type() != NotificationMessageV2::Items && msg.type() != NotificationMessageV2::Collections ) {
+        return -1;
+      }
+
+      const QMap<NotificationMessageV2::Id, NotificationMessageV2::Entity> entities = msg.entities();
+      int previous = -1;
+      QMap<NotificationMessageV2::Id, NotificationMessageV2::Entity>::const_iterator it = entities.constBegin();
+      for ( ; it != entities.constEnd(); ++it ) {
+        const int index = mLastIndex.value( EntityKey( msg.type(), it.key() ), -1 );
+        if ( index < 0 || ( previous >= 0 && index != previous ) ) {
+          return -1;
+        }
+        previous = index;
+      }
+
+      if ( previous >= 0 && mNotifications.at( previous ).type() == NotificationMessageV2::InvalidType ) {
+        return -1;
+      }
+      return previous;
+    }
+
+    /**
+     * Merges @p msg into @p pending, returns @c false if they can't be merged.
+     */
+    bool merge( Msg &pending, const Msg &msg )
+    {
+      const NotificationMessageV2::Operation pendingOp = pending.operation();
+      const NotificationMessageV2::Operation op = msg.operation();
+
+      if ( pendingOp == NotificationMessageV2::Add
+           && ( op == NotificationMessageV2::Modify || op == NotificationMessageV2::ModifyFlags ) ) {
+        return true;
+      }
+
+      if ( pendingOp == NotificationMessageV2::Modify && op == NotificationMessageV2::Modify ) {
+        pending.setItemParts( pending.itemParts() + msg.itemParts() );
+        return true;
+      }
+
+      if ( pendingOp == NotificationMessageV2::ModifyFlags && op == NotificationMessageV2::ModifyFlags ) {
+        QSet<QByteArray> addedFlags = pending.addedFlags();
+        QSet<QByteArray> removedFlags = pending.removedFlags();
+        addedFlags.subtract( msg.removedFlags() );
+        addedFlags.unite( msg.addedFlags() );
+        removedFlags.subtract( msg.addedFlags() );
+        removedFlags.unite( msg.removedFlags() );
+        pending.setAddedFlags( addedFlags );
+        pending.setRemovedFlags( removedFlags );
+        return true;
+      }
+
+      if ( pendingOp == NotificationMessageV2::Add && op == NotificationMessageV2::Remove
+           && msg.type() == NotificationMessageV2::Items ) {
+        // nobody has been told about the items yet
+        pending = Msg();
+        ++mDropped;
+        return true;
+      }
+
+      return false;
+    }
+
+    List mNotifications;
+    QHash<EntityKey, int> mLastIndex;
+    int mDropped;
+};
+
 }
 
 #endif
@@ -121,22 +121,16 @@ QDBusArgument &operator<<( QDBusArgument &arg, const NotificationMessageV3 &msg
   arg << msg.sessionId();
   arg << static_cast<int>( msg.type() );
   arg << static_cast<int>( msg.operation() );
-  arg << msg.entities().values();
+  NotificationMessageHelpers::marshallEntities( arg, msg.entities() );
   arg << msg.resource();
   arg << msg.destinationResource();
   arg << msg.parentCollection();
   arg << msg.parentDestCollection();
-
-  QStringList itemParts;
-  Q_FOREACH ( const QByteArray &itemPart, msg.itemParts() ) {
-    itemParts.append( QString::fromLatin1( itemPart ) );
-  }
-  arg << itemParts;
-
-  arg << msg.addedFlags().toList();
-  arg << msg.removedFlags().toList();
-  arg << msg.addedTags().toList();
-  arg << msg.removedTags().toList();
+  NotificationMessageHelpers::marshallParts( arg, msg.itemParts() );
+  NotificationMessageHelpers::marshallSet( arg, msg.addedFlags() );
+  NotificationMessageHelpers::marshallSet( arg, msg.removedFlags() );
+  NotificationMessageHelpers::marshallSet( arg, msg.addedTags() );
+  NotificationMessageHelpers::marshallSet( arg, msg.removedTags() );
 
   arg.endStructure();
   return arg;
@@ -20,6 +20,7 @@
 
 #include "notificationmessagev2test.h"
 #include <notificationmessagev2_p.h>
+#include <notificationmessagev2_p_p.h>
 
 #include <QSet>
 #include <QtTest/QTest>
@@ -221,6 +222,103 @@ void NotificationMessageV2Test::testNoCompress()
   QCOMPARE( list.count(), 2 );
 }
 
+static NotificationMessageV2 itemNotification( NotificationMessageV2::Operation op, NotificationMessageV2::Id id )
+{
+  NotificationMessageV2 msg;
+  msg.setType( NotificationMessageV2::Items );
+  msg.setOperation( op );
+  msg.setParentCollection( 1 );
+  msg.addEntity( id );
+  return msg;
+}
+
+void NotificationMessageV2Test::testCompressor()
+{
+  NotificationMessageCompressor<NotificationMessageV2> compressor;
+  QVERIFY( compressor.isEmpty() );
+
+  NotificationMessageV2 msg = itemNotification( NotificationMessageV2::Modify, 1 );
+  msg.setItemParts( QSet<QByteArray>() << "PART1" );
+  QVERIFY( compressor.append( msg ) );
+
+  // other items in between don't prevent the compression
+  for ( int i = 2; i < 100; ++i ) {
+    QVERIFY( compressor.append( itemNotification( NotificationMessageV2::Modify, i ) ) );
+  }
+
+  msg.setItemParts( QSet<QByteArray>() << "PART2" );
+  QVERIFY( !compressor.append( msg ) );
+
+  // Modify and ModifyFlags are not merged
+  QVERIFY( compressor.append( itemNotification( NotificationMessageV2::ModifyFlags, 1 ) ) );
+  // neither is a Modify following another notification of the same item
+  QVERIFY( compressor.append( itemNotification( NotificationMessageV2::Modify, 1 ) ) );
+
+  // nor notifications for another parent collection
+  msg = itemNotification( NotificationMessageV2::Modify, 2 );
+  msg.setParentCollection( 2 );
+  QVERIFY( compressor.append( msg ) );
+
+  // modifications following an Add are dropped
+  QVERIFY( compressor.append( itemNotification( NotificationMessageV2::Add, 200 ) ) );
+  QVERIFY( !compressor.append( itemNotification( NotificationMessageV2::Modify, 200 ) ) );
+  QVERIFY( !compressor.append( itemNotification( NotificationMessageV2::ModifyFlags, 200 ) ) );
+
+  const NotificationMessageV2::List list = compressor.takeNotifications();
+  QVERIFY( compressor.isEmpty() );
+  QCOMPARE( list.count(), 103 );
+  QCOMPARE( list.first().itemParts(), QSet<QByteArray>() << "PART1" << "PART2" );
+  QCOMPARE( list.last().operation(), NotificationMessageV2::Add );
+}
+
+void NotificationMessageV2Test::testCompressorFlags()
+{
+  NotificationMessageCompressor<NotificationMessageV2> compressor;
+
+  NotificationMessageV2 msg = itemNotification( NotificationMessageV2::ModifyFlags, 1 );
+  msg.setAddedFlags( QSet<QByteArray>() << "FLAG1" );
+  QVERIFY( compressor.append( msg ) );
+
+  msg.setAddedFlags( QSet<QByteArray>() << "FLAG2" );
+  msg.setRemovedFlags( QSet<QByteArray>() << "FLAG1" << "FLAG3" );
+  QVERIFY( !compressor.append( msg ) );
+
+  const NotificationMessageV2::List list = compressor.takeNotifications();
+  QCOMPARE( list.count(), 1 );
+  QCOMPARE( list.first().addedFlags(), QSet<QByteArray>() << "FLAG2" );
+  QCOMPARE( list.first().removedFlags(), QSet<QByteArray>() << "FLAG1" << "FLAG3" );
+}
+
+void NotificationMessageV2Test::testCompressorAddRemove()
+{
+  NotificationMessageCompressor<NotificationMessageV2> compressor;
+
+  QVERIFY( compressor.append( itemNotification( NotificationMessageV2::Add, 1 ) ) );
+  QVERIFY( compressor.append( itemNotification( NotificationMessageV2::Add, 2 ) ) );
+  QVERIFY( !compressor.append( itemNotification( NotificationMessageV2::Remove, 1 ) ) );
+
+  NotificationMessageV2::List list = compressor.takeNotifications();
+  QCOMPARE( list.count(), 1 );
+  QCOMPARE( list.first().entities().keys(), QList<NotificationMessageV2::Id>() << 2 );
+
+  // a Remove after the item has been moved is kept
+  QVERIFY( compressor.append( itemNotification( NotificationMessageV2::Add, 1 ) ) );
+  QVERIFY( compressor.append( itemNotification( NotificationMessageV2::Move, 1 ) ) );
+  QVERIFY( compressor.append( itemNotification( NotificationMessageV2::Remove, 1 ) ) );
+  list = compressor.takeNotifications();
+  QCOMPARE( list.count(), 3 );
+
+  // collections are never dropped
+  NotificationMessageV2 msg;
+  msg.setType( NotificationMessageV2::Collections );
+  msg.setOperation( NotificationMessageV2::Add );
+  msg.addEntity( 1 );
+  QVERIFY( compressor.append( msg ) );
+  msg.setOperation( NotificationMessageV2::Remove );
+  QVERIFY( compressor.append( msg ) );
+  QCOMPARE( compressor.takeNotifications().count(), 2 );
+}
+
 // void NotificationMessageV2Test::testPartModificationMerge_data()
 // {
 //   QTest::addColumn<NotificationMessageV2::Type>( "type" );
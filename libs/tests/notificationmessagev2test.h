@@ -36,6 +36,9 @@ class NotificationMessageV2Test : public QObject
     void testCompress7();
     // void testCompressWithItemParts();
     void testNoCompress();
+    void testCompressor();
+    void testCompressorFlags();
+    void testCompressorAddRemove();
     // void testPartModificationMerge_data();
     // void testPartModificationMerge();
 };
@@ -275,6 +275,9 @@ bool AkonadiServer::quit()
     }
     mConnections.clear();
 
+    // The tracer singleton is never destroyed, make sure buffered traces end up on disk
+    Tracer::self()->dump();
+
     // Terminate the preprocessor manager before the database but after all connections are gone
     PreprocessorManager::done();
 
@@ -24,11 +24,42 @@
 #include "storage/datastore.h"
 #include "storage/selectquerybuilder.h"
 #include "storage/entity.h"
+#include "storage/transaction.h"
 #include "akonadi.h"
 #include "libs/protocol_p.h"
 
+#include <QThreadPool>
+#include <QRunnable>
+
 using namespace Akonadi::Server;
 
+namespace {
+
+class ExternalPartsRemover : public QRunnable
+{
+  public:
+    ExternalPartsRemover( const QStringList &files )
+      : mFiles( files )
+    {
+    }
+
+    void run()
+    {
+      Q_FOREACH ( const QString &file, mFiles ) {
+        try {
+          PartHelper::removeFile( file );
+        } catch ( const PartHelperException &e ) {
+          akError() << e.type() << e.what();
+        }
+      }
+    }
+
+  private:
+    QStringList mFiles;
+};
+
+}
+
 QMutex CacheCleanerInhibitor::sLock;
 int CacheCleanerInhibitor::sInhibitCount = 0;
 
@@ -98,13 +129,6 @@ int CacheCleaner::collectionScheduleInterval( const Collection &collection )
   return collection.cachePolicyCacheTimeout();
 }
 
-bool CacheCleaner::hasChanged( const Collection &collection, const Collection &changed )
-{
-  return collection.cachePolicyLocalParts() != changed.cachePolicyLocalParts()
-        || collection.cachePolicyCacheTimeout() != changed.cachePolicyCacheTimeout()
-        || collection.cachePolicyInherit() != changed.cachePolicyInherit();
-}
-
 bool CacheCleaner::shouldScheduleCollection( const Collection &collection )
 {
   return collection.cachePolicyLocalParts() != QLatin1String( "ALL" )
@@ -116,36 +140,65 @@ bool CacheCleaner::shouldScheduleCollection( const Collection &collection )
 
 void CacheCleaner::collectionExpired( const Collection &collection )
 {
-  SelectQueryBuilder<Part> qb;
+  QueryBuilder qb( Part::tableName() );
   qb.addJoin( QueryBuilder::InnerJoin, PimItem::tableName(), Part::pimItemIdColumn(), PimItem::idFullColumnName() );
   qb.addJoin( QueryBuilder::InnerJoin, PartType::tableName(), Part::partTypeIdFullColumnName(), PartType::idFullColumnName() );
+  qb.addColumn( Part::idFullColumnName() );
+  qb.addColumn( Part::datasizeFullColumnName() );
   qb.addValueCondition( PimItem::collectionIdFullColumnName(), Query::Equals, collection.id() );
   qb.addValueCondition( PimItem::atimeFullColumnName(), Query::Less, QDateTime::currentDateTime().addSecs( -60 * collection.cachePolicyCacheTimeout() ) );
   qb.addValueCondition( Part::dataFullColumnName(), Query::IsNot, QVariant() );
   qb.addValueCondition( PartType::nsFullColumnName(), Query::Equals, QLatin1String( "PLD" ) );
   qb.addValueCondition( PimItem::dirtyFullColumnName(), Query::Equals, false );
+  qb.addSortColumn( Part::idFullColumnName() );
 
-  QStringList localParts;
   Q_FOREACH ( QString partName, collection.cachePolicyLocalParts().split( QLatin1String( " " ) ) ) {
     if ( partName.startsWith( QLatin1String( AKONADI_PARAM_PLD ) ) ) {
       partName = partName.mid( 4 );
     }
     qb.addValueCondition( PartType::nameFullColumnName(), Query::NotEquals, partName );
   }
-  if ( qb.exec() ) {
-    const Part::List parts = qb.result();
-    if ( !parts.isEmpty() ) {
-      akDebug() << "found" << parts.count() << "item parts to expire in collection" << collection.name();
-      // clear data field
-      Q_FOREACH ( Part part, parts ) {
-        try {
-          if ( !PartHelper::truncate( part ) ) {
-            akDebug() << "failed to update item part" << part.id();
-          }
-        } catch ( const PartHelperException &e ) {
-            akError() << e.type() << e.what();
-        }
-      }
+  if ( !qb.exec() ) {
+    return;
+  }
+
+  // only ids and sizes, the payloads are never loaded
+  QVariantList partIds;
+  QVector<qint64> partSizes;
+  while ( qb.query().next() ) {
+    partIds << qb.query().value( 0 );
+    partSizes << qb.query().value( 1 ).toLongLong();
+  }
+  qb.query().finish();
+  if ( partIds.isEmpty() ) {
+    return;
+  }
+
+  // Truncate the parts in chunks, because something can't handle queries with more than 999 bound values,
+  // leave some room for the values PartHelper::truncate() binds besides the ids
+  const int chunkSize = 990;
+  QStringList externalFiles;
+  int expired = 0;
+  qint64 reclaimed = 0;
+  for ( int start = 0; start < partIds.size(); start += chunkSize ) {
+    const QVariantList ids = partIds.mid( start, chunkSize );
+    QStringList files;
+    Transaction transaction( DataStore::self() );
+    if ( !PartHelper::truncate( ids, files ) || !transaction.commit() ) {
+      akError() << "Failed to expire item parts in collection" << collection.id();
+      break;
     }
+    externalFiles += files;
+    expired += ids.size();
+    for ( int i = start; i < start + ids.size(); ++i ) {
+      reclaimed += partSizes.at( i );
+    }
+  }
+
+  akDebug() << "expired" << expired << "item parts (" << reclaimed << "bytes) in collection" << collection.name();
+
+  // The database no longer references the files, so there is no need to keep the scheduler waiting for them
+  if ( !externalFiles.isEmpty() ) {
+    QThreadPool::globalInstance()->start( new ExternalPartsRemover( externalFiles ) );
   }
 }
@@ -72,7 +72,6 @@ class CacheCleaner : public CollectionScheduler
   protected:
     void collectionExpired( const Collection &collection );
     int collectionScheduleInterval( const Collection &collection );
-    bool hasChanged( const Collection &collection, const Collection &changed );
     bool shouldScheduleCollection( const Collection &collection );
 
   private:
@@ -164,50 +164,59 @@ void CollectionScheduler::collectionAdded( qint64 collectionId )
 void CollectionScheduler::collectionChanged( qint64 collectionId )
 {
   QMutexLocker locker( &mScheduleLock );
-  Q_FOREACH ( const Collection &collection, mSchedule ) {
-    if ( collection.id() == collectionId ) {
-      Collection changed = Collection::retrieveById( collectionId );
-      DataStore::self()->activeCachePolicy( changed );
-      if ( hasChanged( collection, changed ) ) {
-        if ( shouldScheduleCollection( changed ) ) {
-          locker.unlock();
-          // Scheduling the changed collection will automatically remove the old one
-          scheduleCollection( changed );
-        } else {
-          locker.unlock();
-          // If the collection should no longer be scheduled then remove it
-          collectionRemoved( collectionId );
-        }
-      }
-
-      return;
-    }
+  QHash<qint64, ScheduledCollection>::const_iterator it = mScheduledCollections.constFind( collectionId );
+  if ( it == mScheduledCollections.constEnd() ) {
+    locker.unlock();
+    // We don't know the collection yet, but maybe now it can be scheduled
+    collectionAdded( collectionId );
+    return;
+  }
+  const int interval = it->interval;
+  locker.unlock();
+
+  Collection changed = Collection::retrieveById( collectionId );
+  DataStore::self()->activeCachePolicy( changed );
+  if ( !shouldScheduleCollection( changed ) ) {
+    // If the collection should no longer be scheduled then remove it
+    collectionRemoved( collectionId );
+  } else if ( qMax( mMinInterval, collectionScheduleInterval( changed ) ) != interval ) {
+    // Scheduling the changed collection will automatically remove the old one
+    scheduleCollection( changed );
   }
-
-  // We don't know the collection yet, but maybe now it can be scheduled
-  collectionAdded( collectionId );
 }
 
 void CollectionScheduler::collectionRemoved( qint64 collectionId )
 {
   QMutexLocker locker( &mScheduleLock );
-  Q_FOREACH ( const Collection &collection, mSchedule ) {
-    if ( collection.id() == collectionId ) {
-      const uint key = mSchedule.key( collection );
-      const bool reschedule = ( key == mSchedule.constBegin().key() );
-      mSchedule.remove( key );
-      locker.unlock();
-
-      // If we just remove currently scheduled collection, schedule the next one
-      if ( reschedule ) {
-        startScheduler();
-      }
+  const uint next = mSchedule.isEmpty() ? 0 : mSchedule.constBegin().key();
+  const uint timestamp = unscheduleCollection( collectionId );
+  locker.unlock();
 
-      return;
-    }
+  // If we just removed a currently scheduled collection, schedule the next one
+  if ( timestamp != 0 && timestamp == next ) {
+    startScheduler();
   }
 }
 
+uint CollectionScheduler::unscheduleCollection( qint64 collectionId )
+{
+  QHash<qint64, ScheduledCollection>::iterator it = mScheduledCollections.find( collectionId );
+  if ( it == mScheduledCollections.end() ) {
+    return 0;
+  }
+
+  const uint timestamp = it->timestamp;
+  mScheduledCollections.erase( it );
+
+  QMap<uint, QSet<qint64> >::iterator bucket = mSchedule.find( timestamp );
+  Q_ASSERT( bucket != mSchedule.end() );
+  bucket->remove( collectionId );
+  if ( bucket->isEmpty() ) {
+    mSchedule.erase( bucket );
+  }
+  return timestamp;
+}
+
 void CollectionScheduler::startScheduler()
 {
   // Don't restart timer if we are paused.
@@ -231,10 +240,7 @@ void CollectionScheduler::startScheduler()
 void CollectionScheduler::scheduleCollection( Collection collection, bool shouldStartScheduler )
 {
   QMutexLocker locker( &mScheduleLock );
-  if ( mSchedule.values().contains( collection ) ) {
-    const uint key = mSchedule.key( collection );
-    mSchedule.remove( key, collection );
-  }
+  unscheduleCollection( collection.id() );
 
   DataStore::self()->activeCachePolicy( collection );
 
@@ -248,7 +254,7 @@ void CollectionScheduler::scheduleCollection( Collection collection, bool should
   // Check whether there's another check scheduled within a minute after this one.
   // If yes, then delay this check so that it's scheduled together with the others
   // This is a minor optimization to reduce wakeups and SQL queries
-  QMap<uint, Collection>::iterator it = mSchedule.lowerBound( nextCheck );
+  QMap<uint, QSet<qint64> >::iterator it = mSchedule.lowerBound( nextCheck );
   if ( it != mSchedule.end() && it.key() - nextCheck < 60 ) {
     nextCheck = it.key();
 
@@ -261,9 +267,14 @@ void CollectionScheduler::scheduleCollection( Collection collection, bool should
     }
   }
 
-  mSchedule.insert( nextCheck, collection );
+  mSchedule[nextCheck].insert( collection.id() );
+  ScheduledCollection scheduled;
+  scheduled.timestamp = nextCheck;
+  scheduled.interval = expireMinutes;
+  mScheduledCollections.insert( collection.id(), scheduled );
+
   if ( shouldStartScheduler && !mScheduler->isActive() ) {
-    mScheduleLock.unlock();
+    locker.unlock();
     startScheduler();
   }
 }
@@ -300,12 +311,23 @@ void CollectionScheduler::schedulerTimeout()
   mScheduler->stop();
 
   mScheduleLock.lock();
+  if ( mSchedule.isEmpty() ) {
+    mScheduleLock.unlock();
+    return;
+  }
   const uint timestamp = mSchedule.constBegin().key();
-  const QList<Collection> collections = mSchedule.values( timestamp );
-  mSchedule.remove( timestamp );
+  const QSet<qint64> collectionIds = mSchedule.take( timestamp );
+  Q_FOREACH ( qint64 collectionId, collectionIds ) {
+    mScheduledCollections.remove( collectionId );
+  }
   mScheduleLock.unlock();
 
-  Q_FOREACH ( const Collection &collection, collections ) {
+  Q_FOREACH ( qint64 collectionId, collectionIds ) {
+    Collection collection = Collection::retrieveById( collectionId );
+    if ( !collection.isValid() ) {
+      continue;
+    }
+    DataStore::self()->activeCachePolicy( collection );
     collectionExpired( collection );
     scheduleCollection( collection, false );
   }
@@ -23,7 +23,9 @@
 
 #include <QThread>
 #include <QTimer>
-#include <QMultiMap>
+#include <QMap>
+#include <QHash>
+#include <QSet>
 #include <QMutex>
 
 #include "entities.h"
@@ -60,7 +62,6 @@ class CollectionScheduler: public QThread
     virtual void run();
 
     virtual bool shouldScheduleCollection( const Collection &collection ) = 0;
-    virtual bool hasChanged( const Collection &collection, const Collection &changed ) = 0;
     /**
      * @return Return cache timeout in minutes
      */
@@ -76,8 +77,24 @@ class CollectionScheduler: public QThread
     void scheduleCollection( /*sic!*/ Collection collection, bool shouldStartScheduler = true );
 
   protected:
+    /**
+     * Removes @p collectionId from the schedule. Must be called with
+     * mScheduleLock held.
+     *
+     * @return The timestamp the collection was scheduled for, or 0 if it
+     * was not scheduled.
+     */
+    uint unscheduleCollection( qint64 collectionId );
+
+    struct ScheduledCollection
+    {
+      uint timestamp;
+      int interval; // minutes
+    };
+
     QMutex mScheduleLock;
-    QMultiMap<uint /*timestamp*/, Collection> mSchedule;
+    QMap<uint /*timestamp*/, QSet<qint64> /*collectionIds*/> mSchedule;
+    QHash<qint64 /*collectionId*/, ScheduledCollection> mScheduledCollections;
     PauseableTimer *mScheduler;
     int mMinInterval;
 };
@@ -19,9 +19,12 @@
  ***************************************************************************/
 #include "connection.h"
 
+#include <QtCore/QAtomicInt>
 #include <QtCore/QDebug>
 #include <QtCore/QEventLoop>
+#include <QtCore/QFile>
 #include <QtCore/QLatin1String>
+#include <QtCore/QTimer>
 #include <QSettings>
 
 #include "storage/datastore.h"
@@ -41,6 +44,15 @@
 
 #define AKONADI_PROTOCOL_VERSION 44
 
+// Amount of pending output after which writeOut() waits for the client to catch up
+static const qint64 s_outputHighWaterMark = 4 * 1024 * 1024;
+// Size of the chunks in which file literals are written to the socket
+static const qint64 s_fileLiteralChunkSize = 256 * 1024;
+
+// Incremented whenever collections change their resource, makes all connections drop
+// their cached collection resources
+static QAtomicInt s_collectionResourcesGeneration;
+
 using namespace Akonadi::Server;
 
 Connection::Connection( QObject *parent )
@@ -52,7 +64,12 @@ Connection::Connection( QObject *parent )
     , m_backend( 0 )
     , m_streamParser( 0 )
     , m_verifyCacheOnRetrieval( false )
+    , m_streamExternalPayloads( false )
+    , m_asyncItemRetrieval( false )
+    , m_idleTimer( 0 )
     , m_totalTime( 0 )
+    , m_collectionResourcesGeneration( -1 )
+    , m_sessionResourceId( -1 )
     , m_reportTime( false )
 {
 }
@@ -67,7 +84,12 @@ Connection::Connection( quintptr socketDescriptor, QObject *parent )
     , m_backend( 0 )
     , m_streamParser( 0 )
     , m_verifyCacheOnRetrieval( false )
+    , m_streamExternalPayloads( false )
+    , m_asyncItemRetrieval( false )
+    , m_idleTimer( 0 )
     , m_totalTime( 0 )
+    , m_collectionResourcesGeneration( -1 )
+    , m_sessionResourceId( -1 )
     , m_reportTime( false )
 {
     m_identifier.sprintf( "%p", static_cast<void *>( this ) );
@@ -75,6 +97,19 @@ Connection::Connection( quintptr socketDescriptor, QObject *parent )
 
     const QSettings settings( AkStandardDirs::serverConfigFile(), QSettings::IniFormat );
     m_verifyCacheOnRetrieval = settings.value( QLatin1String( "Cache/VerifyOnRetrieval" ), m_verifyCacheOnRetrieval ).toBool();
+    m_streamExternalPayloads = settings.value( QLatin1String( "Connection/StreamExternalPayloads" ), true ).toBool();
+    m_asyncItemRetrieval = settings.value( QLatin1String( "Connection/AsyncItemRetrieval" ), true ).toBool();
+
+    // Most clients are idle most of the time, don't keep a database connection
+    // open for each of them. 0 disables releasing the database connection.
+    const int releaseAfterIdle = settings.value( QLatin1String( "Connection/ReleaseDatabaseAfterIdle" ), 60 ).toInt();
+    if ( releaseAfterIdle > 0 ) {
+        m_idleTimer = new QTimer( this );
+        m_idleTimer->setSingleShot( true );
+        m_idleTimer->setInterval( releaseAfterIdle * 1000 );
+        connect( m_idleTimer, SIGNAL(timeout()),
+                 this, SLOT(releaseDatabaseConnection()) );
+    }
 
     QLocalSocket *socket = new QLocalSocket();
 
@@ -156,8 +191,12 @@ void Connection::slotNewData()
     return;
   }
 
+  if ( m_idleTimer ) {
+    m_idleTimer->stop();
+  }
+
   QString currentCommand;
-  while ( m_socket->bytesAvailable() > 0 || !m_streamParser->readRemainingData().isEmpty() ) {
+  while ( m_socket->bytesAvailable() > 0 || m_streamParser->hasRemainingData() ) {
     try {
       const QByteArray tag = m_streamParser->readString();
       // deal with stray newlines
@@ -170,7 +209,9 @@ void Connection::slotNewData()
       }
       context()->setTag( -1 );
       context()->setCollection( Collection() );
-      Tracer::self()->connectionInput( m_identifier, ( tag + ' ' + command + ' ' + m_streamParser->readRemainingData() ) );
+      if ( Tracer::self()->isEnabled() ) {
+        Tracer::self()->connectionInput( m_identifier, ( tag + ' ' + command + ' ' + m_streamParser->readRemainingData() ) );
+      }
       m_currentHandler = findHandlerForCommand( command );
       currentCommand = QString::fromLatin1(command);
       if (m_reportTime) {
@@ -221,15 +262,75 @@ void Connection::slotNewData()
       } catch ( ... ) {}
     }
   }
+
+  if ( m_idleTimer ) {
+    m_idleTimer->start();
+  }
+}
+
+void Connection::releaseDatabaseConnection()
+{
+  // the database connection is reopened by the DataStore when it's needed again
+  if ( m_backend && !m_currentHandler ) {
+    m_backend->releaseConnection();
+  }
 }
 
 void Connection::writeOut( const QByteArray &data )
 {
-    QByteArray block = data + "\r\n";
-    m_socket->write( block );
-    m_socket->waitForBytesWritten( 30 * 1000 );
+    // The socket buffers and coalesces the responses and writes them out from
+    // the event loop, we only block here once the client falls behind by more
+    // than the high-water mark.
+    m_socket->write( data );
+    m_socket->write( "\r\n", 2 );
+    waitForClient();
+
+    Tracer::self()->connectionOutput( m_identifier, data );
+}
+
+void Connection::waitForClient()
+{
+    while ( m_socket->bytesToWrite() > s_outputHighWaterMark ) {
+        if ( !m_socket->waitForBytesWritten( 30 * 1000 ) ) {
+            break;
+        }
+    }
+}
+
+void Connection::writeFileLiteral( const QString &fileName, qint64 size )
+{
+    QFile file( fileName );
+    if ( !file.open( QIODevice::ReadOnly ) ) {
+        akError() << "Payload file" << fileName << "could not be opened for reading:" << file.errorString();
+    }
 
-    Tracer::self()->connectionOutput( m_identifier, block );
+    // Map the file and write it in chunks, so that it is never loaded into
+    // memory as a whole and the output buffer stays below the high-water mark
+    qint64 written = 0;
+    uchar *mapped = file.isOpen() ? file.map( 0, size ) : 0;
+    if ( mapped ) {
+        while ( written < size ) {
+            const qint64 chunkSize = qMin( size - written, s_fileLiteralChunkSize );
+            m_socket->write( reinterpret_cast<const char *>( mapped ) + written, chunkSize );
+            written += chunkSize;
+            waitForClient();
+        }
+        file.unmap( mapped );
+        return;
+    }
+
+    while ( written < size ) {
+        QByteArray chunk = file.isOpen() ? file.read( qMin( size - written, s_fileLiteralChunkSize ) ) : QByteArray();
+        if ( chunk.isEmpty() ) {
+            // The literal size has already been announced to the client, so
+            // we have no choice but to pad the data to keep the stream intact
+            akError() << "Payload file" << fileName << "is shorter than expected, padding" << ( size - written ) << "bytes";
+            chunk = QByteArray( qMin( size - written, s_fileLiteralChunkSize ), '\0' );
+        }
+        m_socket->write( chunk );
+        written += chunk.size();
+        waitForClient();
+    }
 }
 
 CommandContext *Connection::context() const
@@ -267,7 +368,24 @@ void Connection::slotResponseAvailable( const Response &response )
 {
     // FIXME handle reentrancy in the presence of continuation. Something like:
     // "if continuation pending, queue responses, once continuation is done, replay them"
-    writeOut( response.asString() );
+    const QVector<Response::FileLiteral> fileLiterals = response.fileLiterals();
+    if ( fileLiterals.isEmpty() ) {
+        writeOut( response.asString() );
+        return;
+    }
+
+    const QByteArray data = response.asString();
+    int position = 0;
+    Q_FOREACH ( const Response::FileLiteral &literal, fileLiterals ) {
+        m_socket->write( data.constData() + position, literal.position - position );
+        writeFileLiteral( literal.fileName, literal.size );
+        position = literal.position;
+    }
+    m_socket->write( data.constData() + position, data.size() - position );
+    m_socket->write( "\r\n", 2 );
+    waitForClient();
+
+    Tracer::self()->connectionOutput( m_identifier, data );
 }
 
 void Connection::slotConnectionStateChange( ConnectionState state )
@@ -317,6 +435,7 @@ void Connection::setSessionId( const QByteArray &id )
   m_streamParser->setTracerIdentifier( m_identifier );
 
   m_sessionId = id;
+  m_sessionResourceId = -1;
   setObjectName( QString::fromLatin1( id ) );
   storageBackend()->setSessionId( id );
   storageBackend()->notificationCollector()->setSessionId( id );
@@ -329,25 +448,57 @@ QByteArray Connection::sessionId() const
 
 bool Connection::isOwnerResource( const PimItem &item ) const
 {
-  if ( context()->resource().isValid() && item.collection().resourceId() == context()->resource().id() ) {
-    return true;
+  return isOwnerResource( collectionResourceId( item.collectionId() ) );
+}
+
+bool Connection::isOwnerResource( const Collection &collection ) const
+{
+  return isOwnerResource( collection.resourceId() );
+}
+
+bool Connection::isOwnerResource( Resource::Id resourceId ) const
+{
+  if ( resourceId <= 0 ) {
+    return false;
   }
-  // fallback for older resources
-  if ( sessionId() == item.collection().resource().name().toUtf8() ) {
+  if ( context()->resource().isValid() && resourceId == context()->resource().id() ) {
     return true;
   }
-  return false;
+  // fallback for older resources, which use their name as session id
+  if ( m_sessionResourceId < 0 ) {
+    const Resource resource = Resource::retrieveByName( QString::fromUtf8( m_sessionId ) );
+    m_sessionResourceId = resource.isValid() ? resource.id() : 0;
+  }
+  return resourceId == m_sessionResourceId;
 }
 
-bool Connection::isOwnerResource( const Collection &collection ) const
+Resource::Id Connection::collectionResourceId( Collection::Id collectionId ) const
 {
-  if ( context()->resource().isValid() && collection.resourceId() == context()->resource().id() ) {
-    return true;
+  // read before looking up the collection, so that a change committed
+  // meanwhile drops the result again on the next call
+  const int generation = s_collectionResourcesGeneration.fetchAndAddOrdered( 0 );
+  if ( generation != m_collectionResourcesGeneration ) {
+    m_collectionResources.clear();
+    m_sessionResourceId = -1;
+    m_collectionResourcesGeneration = generation;
   }
-  if ( sessionId() == collection.resource().name().toUtf8() ) {
-    return true;
+
+  QHash<Collection::Id, Resource::Id>::const_iterator it = m_collectionResources.constFind( collectionId );
+  if ( it != m_collectionResources.constEnd() ) {
+    return it.value();
   }
-  return false;
+
+  const Collection collection = Collection::retrieveById( collectionId );
+  if ( !collection.isValid() ) {
+    return -1;
+  }
+  m_collectionResources.insert( collectionId, collection.resourceId() );
+  return collection.resourceId();
+}
+
+void Connection::invalidateCollectionResources()
+{
+  s_collectionResourcesGeneration.fetchAndAddOrdered( 1 );
 }
 
 const ClientCapabilities &Connection::capabilities() const
@@ -367,6 +518,24 @@ bool Connection::verifyCacheOnRetrieval() const
   return m_verifyCacheOnRetrieval;
 }
 
+bool Connection::streamExternalPayloads() const
+{
+  return m_streamExternalPayloads;
+}
+
+bool Connection::asyncItemRetrieval() const
+{
+  return m_asyncItemRetrieval;
+}
+
+void Connection::flushOutput()
+{
+  QLocalSocket *socket = qobject_cast<QLocalSocket *>( m_socket );
+  if ( socket ) {
+    socket->flush();
+  }
+}
+
 void Connection::startTime()
 {
     m_time.start();
@@ -29,6 +29,8 @@
 #include "clientcapabilities.h"
 #include "commandcontext.h"
 
+class QTimer;
+
 namespace Akonadi {
 namespace Server {
 
@@ -63,6 +65,13 @@ public:
     bool isOwnerResource( const PimItem &item ) const;
     bool isOwnerResource( const Collection &collection ) const;
 
+    /**
+      Drops the collection to resource mapping cached by all connections for
+      isOwnerResource(). Call this when collections are moved to another
+      resource or removed.
+    */
+    static void invalidateCollectionResources();
+
     void addStatusMessage( const QByteArray &msg );
     void flushStatusMessageQueue();
 
@@ -75,6 +84,26 @@ public:
     /** Returns @c true if permanent cache verification is enabled. */
     bool verifyCacheOnRetrieval() const;
 
+    /**
+      Returns @c true if external payload parts should be streamed directly
+      from the file store to clients which do not support external payloads,
+      instead of being loaded into memory.
+    */
+    bool streamExternalPayloads() const;
+
+    /**
+      Returns @c true if FETCH should send cached items right away and
+      stream items that have to be retrieved from the resource as soon as
+      they arrive, rather than waiting for all of them first.
+    */
+    bool asyncItemRetrieval() const;
+
+    /**
+      Writes out as much of the buffered output as possible without blocking.
+      Call this before blocking the connection thread for a longer time.
+    */
+    void flushOutput();
+
 Q_SIGNALS:
     void disconnected();
 
@@ -87,10 +116,17 @@ protected Q_SLOTS:
 
     virtual void slotResponseAvailable( const Akonadi::Server::Response &response );
 
+    /**
+     * Releases the database connection after the client has been idle for a while.
+     */
+    void releaseDatabaseConnection();
+
 protected:
     Connection(QObject *parent = 0); // used for testing
 
     void writeOut( const QByteArray &data );
+    void writeFileLiteral( const QString &fileName, qint64 size );
+    void waitForClient();
     virtual Handler *findHandlerForCommand( const QByteArray &command );
 
 protected:
@@ -105,6 +141,9 @@ protected:
     ImapStreamParser *m_streamParser;
     ClientCapabilities m_clientCapabilities;
     bool m_verifyCacheOnRetrieval;
+    bool m_streamExternalPayloads;
+    bool m_asyncItemRetrieval;
+    QTimer *m_idleTimer;
     CommandContext m_context;
     QTime m_time;
     qint64 m_totalTime;
@@ -112,6 +151,15 @@ protected:
     QHash<QString, qint64> m_executionsByHandler;
 
 private:
+    bool isOwnerResource( Resource::Id resourceId ) const;
+    Resource::Id collectionResourceId( Collection::Id collectionId ) const;
+
+    /// resource of collections, to avoid looking up collection and resource for every item
+    mutable QHash<Collection::Id, Resource::Id> m_collectionResources;
+    mutable int m_collectionResourcesGeneration;
+    /// resource named like the session id, -1 if not looked up yet
+    mutable Resource::Id m_sessionResourceId;
+
     /** For debugging */
     void startTime();
     void stopTime(const QString &identifier);
@@ -20,6 +20,7 @@
 #include "debuginterface.h"
 #include "debuginterfaceadaptor.h"
 #include "tracer.h"
+#include "storage/querycache.h"
 #include <QtDBus>
 
 using namespace Akonadi::Server;
@@ -41,3 +42,8 @@ void DebugInterface::setTracer( const QString &tracer )
 {
   Tracer::self()->activateTracer( tracer );
 }
+
+QStringList DebugInterface::queryCacheStatistics() const
+{
+  return QueryCache::statistics();
+}
@@ -21,6 +21,7 @@
 #define AKONADI_DEBUGINTERFACE_H
 
 #include <QObject>
+#include <QStringList>
 
 namespace Akonadi {
 namespace Server {
@@ -40,6 +41,9 @@ class DebugInterface : public QObject
     Q_SCRIPTABLE QString tracer() const;
     Q_SCRIPTABLE void setTracer( const QString &tracer );
 
+    /** Returns the statistics of the prepared query caches, one entry per thread. */
+    Q_SCRIPTABLE QStringList queryCacheStatistics() const;
+
 };
 
 } // namespace Server
@@ -48,18 +48,16 @@ bool Copy::copyItem( const PimItem &item, const Collection &target )
   newItem.setRemoteId( QString() );
   newItem.setRemoteRevision( QString() );
   newItem.setCollectionId( target.id() );
+  // the parts are copied afterwards without loading the payloads
   Part::List parts;
-  Q_FOREACH ( const Part &part, item.parts() ) {
-    Part newPart( part );
-    newPart.setData( PartHelper::translateData( newPart.data(), part.external() ) );
-    newPart.setPimItemId( -1 );
-    parts << newPart;
-  }
 
   DataStore *store = connection()->storageBackend();
   if ( !store->appendPimItem( parts, item.mimeType(), target, QDateTime::currentDateTime(), QString(), QString(), item.gid(), newItem ) ) {
     return false;
   }
+  if ( !PartHelper::copyParts( item.id(), newItem.id() ) ) {
+    return false;
+  }
   Q_FOREACH ( const Flag &flag, item.flags() ) {
     if ( !newItem.addFlag( flag ) ) {
       return false;
@@ -34,6 +34,8 @@
 #include "storage/itemretrievalmanager.h"
 #include "storage/itemretrievalrequest.h"
 #include "storage/parthelper.h"
+#include "storage/querycache.h"
+#include "storage/queryhelper.h"
 #include <storage/parttypehelper.h>
 #include "storage/transaction.h"
 #include "utils.h"
@@ -44,10 +46,12 @@
 #include "relationfetch.h"
 
 #include <QtCore/QLocale>
+#include <QtCore/QSet>
 #include <QtCore/QStringList>
 #include <QtCore/QUuid>
 #include <QtCore/QVariant>
 #include <QtCore/QDateTime>
+#include <QtCore/QFileInfo>
 #include <QtSql/QSqlDatabase>
 #include <QtSql/QSqlError>
 #include <QtSql/QSqlQuery>
@@ -55,6 +59,24 @@
 using namespace Akonadi;
 using namespace Akonadi::Server;
 
+namespace {
+
+/// Waits for and deletes retrieval requests that are still in flight when leaving the scope
+class PendingRetrievals
+{
+  public:
+    ~PendingRetrievals()
+    {
+      while ( !requests.isEmpty() ) {
+        qDeleteAll( ItemRetrievalManager::instance()->waitForItemDelivery( requests ) );
+      }
+    }
+
+    QList<ItemRetrievalRequest *> requests;
+};
+
+}
+
 FetchHelper::FetchHelper( Connection *connection, const Scope &scope, const FetchScope &fetchScope )
   : mStreamParser( 0 )
   , mConnection( connection )
@@ -257,6 +279,42 @@ QSqlQuery FetchHelper::buildVRefQuery()
   return vRefQuery.query();
 }
 
+enum RelationQueryColumns {
+  RelationQueryItemIdColumn,
+  RelationQueryLeftIdColumn,
+  RelationQueryRightIdColumn,
+  RelationQueryTypeNameColumn,
+  RelationQueryRemoteIdColumn
+};
+
+QSqlQuery FetchHelper::buildRelationQuery()
+{
+  // An item can be on either side of a relation, so we join on both columns
+  // and let the merge-join in fetchItems() pick the rows for each item.
+  Query::Condition joinCondition( Query::Or );
+  joinCondition.addColumnCondition( PimItem::idFullColumnName(), Query::Equals, Relation::leftIdFullColumnName() );
+  joinCondition.addColumnCondition( PimItem::idFullColumnName(), Query::Equals, Relation::rightIdFullColumnName() );
+
+  QueryBuilder relationQuery( PimItem::tableName() );
+  relationQuery.addJoin( QueryBuilder::InnerJoin, Relation::tableName(), joinCondition );
+  relationQuery.addJoin( QueryBuilder::InnerJoin, RelationType::tableName(),
+                         Relation::typeIdFullColumnName(), RelationType::idFullColumnName() );
+  relationQuery.addColumn( PimItem::idFullColumnName() );
+  relationQuery.addColumn( Relation::leftIdFullColumnName() );
+  relationQuery.addColumn( Relation::rightIdFullColumnName() );
+  relationQuery.addColumn( RelationType::nameFullColumnName() );
+  relationQuery.addColumn( Relation::remoteIdFullColumnName() );
+  ItemQueryHelper::scopeToQuery( mScope, mConnection->context(), relationQuery );
+  relationQuery.addSortColumn( PimItem::idFullColumnName(), Query::Descending );
+
+  if ( !relationQuery.exec() ) {
+    throw HandlerException( "Unable to list item relations" );
+  }
+
+  relationQuery.query().next();
+
+  return relationQuery.query();
+}
 
 bool FetchHelper::isScopeLocal( const Scope &scope )
 {
@@ -301,38 +359,94 @@ bool FetchHelper::isScopeLocal( const Scope &scope )
   return properties.value( QLatin1String( "HasLocalStorage" ), false ).toBool();
 }
 
-QByteArray FetchHelper::tagsToByteArray( const Tag::List &tags )
+void FetchHelper::loadTagDictionary( QSqlQuery &itemTagQuery )
 {
-  QByteArray b;
-  b += "(";
-  Q_FOREACH ( const Tag &tag, tags ) {
-    b += "(" + TagFetchHelper::tagToByteArray( tag.id(),
-                                               tag.gid().toLatin1(),
-                                               tag.parentId(),
-                                               tag.tagType().name().toLatin1(),
-                                               QByteArray(),
-                                               TagFetchHelper::fetchTagAttributes( tag.id() ) ) + ") ";
-  }
-  b += ")";
-  return b;
+  // Collect the IDs of all tags assigned to items in the scope and rewind the
+  // query so it can be merge-joined with the items afterwards
+  QSet<qint64> tagIds;
+  while ( itemTagQuery.isValid() ) {
+    tagIds.insert( itemTagQuery.value( TagQueryTagIdColumn ).toLongLong() );
+    itemTagQuery.next();
+  }
+  itemTagQuery.first();
+
+  if ( tagIds.isEmpty() ) {
+    return;
+  }
+
+  ImapSet tagSet;
+  tagSet.add( tagIds );
+
+  QueryBuilder tagQuery( Tag::tableName() );
+  tagQuery.addJoin( QueryBuilder::InnerJoin, TagType::tableName(),
+                    Tag::typeIdFullColumnName(), TagType::idFullColumnName() );
+  tagQuery.addColumn( Tag::idFullColumnName() );
+  tagQuery.addColumn( Tag::gidFullColumnName() );
+  tagQuery.addColumn( Tag::parentIdFullColumnName() );
+  tagQuery.addColumn( TagType::nameFullColumnName() );
+  QueryHelper::setToQuery( tagSet, Tag::idFullColumnName(), tagQuery );
+  tagQuery.addSortColumn( Tag::idFullColumnName(), Query::Descending );
+  if ( !tagQuery.exec() ) {
+    throw HandlerException( "Unable to retrieve tags" );
+  }
+
+  QueryBuilder attributeQuery( TagAttribute::tableName() );
+  attributeQuery.addColumn( TagAttribute::tagIdFullColumnName() );
+  attributeQuery.addColumn( TagAttribute::typeFullColumnName() );
+  attributeQuery.addColumn( TagAttribute::valueFullColumnName() );
+  QueryHelper::setToQuery( tagSet, TagAttribute::tagIdFullColumnName(), attributeQuery );
+  attributeQuery.addSortColumn( TagAttribute::tagIdFullColumnName(), Query::Descending );
+  if ( !attributeQuery.exec() ) {
+    throw HandlerException( "Unable to retrieve tag attributes" );
+  }
+
+  QSqlQuery tags = tagQuery.query();
+  QSqlQuery attributes = attributeQuery.query();
+  attributes.next();
+  while ( tags.next() ) {
+    const qint64 tagId = tags.value( 0 ).toLongLong();
+
+    QList<QByteArray> tagAttributes;
+    while ( attributes.isValid() ) {
+      const qint64 id = attributes.value( 0 ).toLongLong();
+      if ( id > tagId ) {
+        attributes.next();
+        continue;
+      } else if ( id < tagId ) {
+        break;
+      }
+      tagAttributes << attributes.value( 1 ).toByteArray() << ImapParser::quote( attributes.value( 2 ).toByteArray() );
+      attributes.next();
+    }
+
+    mTagDictionary.insert( tagId, TagFetchHelper::tagToByteArray( tagId,
+                                                                  tags.value( 1 ).toString().toLatin1(),
+                                                                  tags.value( 2 ).toLongLong(),
+                                                                  tags.value( 3 ).toString().toLatin1(),
+                                                                  QByteArray(),
+                                                                  tagAttributes ) );
+  }
 }
 
-QByteArray FetchHelper::relationsToByteArray(const Relation::List &relations)
+QString FetchHelper::retrievalErrorMessage( const QString &error ) const
 {
-    QByteArray b;
-    b += "(";
-    Q_FOREACH (const Relation &relation, relations) {
-        b += "(" + RelationFetch::relationToByteArray(relation.leftId(),
-                                                      relation.rightId(),
-                                                      relation.relationType().name().toLatin1(),
-                                                      relation.remoteId().toLatin1()) + ") ";
-    }
-    b += ")";
-    return b;
+  if ( mConnection->context()->resource().isValid() ) {
+    return QString::fromLatin1( "Unable to fetch item from backend (collection %1, resource %2) : %3" )
+            .arg( mConnection->context()->collectionId() )
+            .arg( mConnection->context()->resource().id() )
+            .arg( error );
+  } else {
+    return QString::fromLatin1( "Unable to fetch item from backend (collection %1) : %2" )
+            .arg( mConnection->context()->collectionId() )
+            .arg( error );
+  }
 }
 
 bool FetchHelper::fetchItems( const QByteArray &responseIdentifier )
 {
+  // retrieval requests still being processed by the resources
+  PendingRetrievals retrievals;
+
   // retrieve missing parts
   // HACK: isScopeLocal() is a workaround for resources that have cache expiration
   // because when the cache expires, Baloo is not able to content of the items. So
@@ -351,20 +465,22 @@ bool FetchHelper::fetchItems( const QByteArray &responseIdentifier )
     retriever.setRetrieveParts( mFetchScope.requestedPayloads() );
     retriever.setRetrieveFullPayload( mFetchScope.fullPayload() );
     retriever.setChangedSince( mFetchScope.changedSince() );
-    if ( !retriever.exec() && !mFetchScope.ignoreErrors() ) { // There we go, retrieve the missing parts from the resource.
-      if ( mConnection->context()->resource().isValid() ) {
-        throw HandlerException( QString::fromLatin1( "Unable to fetch item from backend (collection %1, resource %2) : %3" )
-                .arg( mConnection->context()->collectionId() )
-                .arg( mConnection->context()->resource().id() )
-                .arg( QString::fromLatin1( retriever.lastError() ) ) );
-      } else {
-        throw HandlerException( QString::fromLatin1( "Unable to fetch item from backend (collection %1) : %2" )
-                .arg( mConnection->context()->collectionId() )
-                .arg( QString::fromLatin1( retriever.lastError() ) ) );
+    if ( mConnection->asyncItemRetrieval() ) {
+      // send the cached items right away, the others follow once the resource delivered them
+      retrievals.requests = retriever.prepareRequests();
+      if ( !retrievals.requests.isEmpty() ) {
+        ItemRetrievalManager::instance()->postItemDelivery( retrievals.requests );
       }
+    } else if ( !retriever.exec() && !mFetchScope.ignoreErrors() ) { // There we go, retrieve the missing parts from the resource.
+      throw HandlerException( retrievalErrorMessage( QString::fromLatin1( retriever.lastError() ) ) );
     }
   }
 
+  QSet<qint64> pendingItems;
+  Q_FOREACH ( const ItemRetrievalRequest *request, retrievals.requests ) {
+    pendingItems.insert( request->id );
+  }
+
   QSqlQuery itemQuery = buildItemQuery();
 
   // error if query did not find any item and scope is not listing items but
@@ -384,6 +500,52 @@ bool FetchHelper::fetchItems( const QByteArray &responseIdentifier )
         break;
     }
   }
+
+  sendItems( itemQuery, responseIdentifier, pendingItems );
+
+  // stream the remaining items as soon as they have been retrieved
+  QStringList retrievalErrors;
+  const Scope scope = mScope;
+  while ( !retrievals.requests.isEmpty() ) {
+    // let the client process what we have so far while we are waiting
+    mConnection->flushOutput();
+    // the resource cannot store the retrieved parts while our queries still lock the tables
+    QueryCache::finishQueries();
+
+    const QList<ItemRetrievalRequest *> processed = ItemRetrievalManager::instance()->waitForItemDelivery( retrievals.requests );
+    ImapSet retrievedItems;
+    Q_FOREACH ( const ItemRetrievalRequest *request, processed ) {
+      if ( request->errorMsg.isEmpty() || mFetchScope.ignoreErrors() ) {
+        retrievedItems.add( QVector<qint64>() << request->id );
+      } else {
+        retrievalErrors << QString::fromLatin1( "item %1: %2" ).arg( request->id ).arg( request->errorMsg );
+      }
+    }
+    qDeleteAll( processed );
+
+    if ( !retrievedItems.isEmpty() ) {
+      mScope = Scope( Scope::Uid );
+      mScope.setUidSet( retrievedItems );
+      QSqlQuery retrievedItemQuery = buildItemQuery();
+      sendItems( retrievedItemQuery, responseIdentifier, QSet<qint64>() );
+      mScope = scope;
+    }
+  }
+
+  // update atime (only if the payload was actually requested, otherwise a simple resource sync prevents cache clearing)
+  if ( needsAccessTimeUpdate( mFetchScope.requestedParts() ) || mFetchScope.fullPayload() ) {
+    updateItemAccessTime();
+  }
+
+  if ( !retrievalErrors.isEmpty() ) {
+    throw HandlerException( retrievalErrorMessage( retrievalErrors.join( QLatin1String( "; " ) ) ) );
+  }
+
+  return true;
+}
+
+void FetchHelper::sendItems( QSqlQuery &itemQuery, const QByteArray &responseIdentifier, const QSet<qint64> &skippedItems )
+{
   // build part query if needed
   QSqlQuery partQuery;
   if ( !mFetchScope.requestedParts().isEmpty() || mFetchScope.fullPayload() || mFetchScope.allAttributes() ) {
@@ -400,6 +562,16 @@ bool FetchHelper::fetchItems( const QByteArray &responseIdentifier )
   QSqlQuery tagQuery;
   if ( mFetchScope.tagsRequested() ) {
     tagQuery = buildTagQuery();
+    //We don't take the fetch scope into account yet. It's either id only or the full tag.
+    if ( !mFetchScope.tagFetchScope().isEmpty() ) {
+      loadTagDictionary( tagQuery );
+    }
+  }
+
+  // build relation query if needed
+  QSqlQuery relationQuery;
+  if ( mFetchScope.relationsRequested() ) {
+    relationQuery = buildRelationQuery();
   }
 
   QSqlQuery vRefQuery;
@@ -408,10 +580,12 @@ bool FetchHelper::fetchItems( const QByteArray &responseIdentifier )
   }
 
   // build responses
-  Response response;
-  response.setUntagged();
   while ( itemQuery.isValid() ) {
     const qint64 pimItemId = extractQueryResult( itemQuery, ItemQueryPimItemIdColumn ).toLongLong();
+    if ( skippedItems.contains( pimItemId ) ) {
+      itemQuery.next();
+      continue;
+    }
     const int pimItemRev = extractQueryResult( itemQuery, ItemQueryRevColumn ).toInt();
 
     QList<QByteArray> attributes;
@@ -466,7 +640,6 @@ bool FetchHelper::fetchItems( const QByteArray &responseIdentifier )
     if ( mFetchScope.tagsRequested() ) {
       ImapSet tags;
       QVector<qint64> tagIds;
-      //We don't take the fetch scope into account yet. It's either id only or the full tag.
       const bool fullTagsRequested = !mFetchScope.tagFetchScope().isEmpty();
       while ( tagQuery.isValid() ) {
         const qint64 id = tagQuery.value( TagQueryItemIdColumn ).toLongLong();
@@ -487,27 +660,33 @@ bool FetchHelper::fetchItems( const QByteArray &responseIdentifier )
           attributes.append( AKONADI_PARAM_TAGS " " + tags.toImapSequenceSet() );
         }
       } else {
-        Tag::List tagList;
+        QByteArray tagList = "(";
         Q_FOREACH ( qint64 t, tagIds ) {
-          tagList << Tag::retrieveById( t );
+          tagList += "(" + mTagDictionary.value( t ) + ") ";
         }
-        attributes.append( AKONADI_PARAM_TAGS " " + tagsToByteArray( tagList ) );
+        tagList += ")";
+        attributes.append( AKONADI_PARAM_TAGS " " + tagList );
       }
-        }
+    }
 
-        if (mFetchScope.relationsRequested()) {
-            SelectQueryBuilder<Relation> qb;
-            Query::Condition condition;
-            condition.setSubQueryMode(Query::Or);
-            condition.addValueCondition(Relation::leftIdFullColumnName(), Query::Equals, pimItemId);
-            condition.addValueCondition(Relation::rightIdFullColumnName(), Query::Equals, pimItemId);
-            qb.addCondition(condition);
-            qb.addGroupColumns(QStringList() << Relation::leftIdColumn() << Relation::rightIdColumn() << Relation::typeIdColumn());
-            if (!qb.exec()) {
-                throw HandlerException("Unable to list item relations");
-            }
-            const Relation::List relations = qb.result();
-            attributes.append(AKONADI_PARAM_RELATIONS " " + relationsToByteArray(relations));
+    if ( mFetchScope.relationsRequested() ) {
+      QByteArray relations = "(";
+      while ( relationQuery.isValid() ) {
+        const qint64 id = relationQuery.value( RelationQueryItemIdColumn ).toLongLong();
+        if ( id > pimItemId ) {
+          relationQuery.next();
+          continue;
+        } else if ( id < pimItemId ) {
+          break;
+        }
+        relations += "(" + RelationFetch::relationToByteArray( relationQuery.value( RelationQueryLeftIdColumn ).toLongLong(),
+                                                               relationQuery.value( RelationQueryRightIdColumn ).toLongLong(),
+                                                               relationQuery.value( RelationQueryTypeNameColumn ).toString().toLatin1(),
+                                                               relationQuery.value( RelationQueryRemoteIdColumn ).toString().toLatin1() ) + ") ";
+        relationQuery.next();
+      }
+      relations += ")";
+      attributes.append( AKONADI_PARAM_RELATIONS " " + relations );
     }
 
     if ( mFetchScope.virtualReferencesRequested() ) {
@@ -536,6 +715,8 @@ bool FetchHelper::fetchItems( const QByteArray &responseIdentifier )
     bool skipItem = false;
 
     QList<QByteArray> cachedParts;
+    // external files to stream into the response, by index in attributes
+    QHash<int, QPair<QString, qint64> > fileLiterals;
 
     while ( partQuery.isValid() ) {
       const qint64 id = partQuery.value( PartQueryPimIdColumn ).toLongLong();
@@ -564,8 +745,18 @@ bool FetchHelper::fetchItems( const QByteArray &responseIdentifier )
           break;
         }
         const bool partIsExternal = partQuery.value( PartQueryExternalColumn ).toBool();
+        QString streamedFileName;
+        qint64 streamedFileSize = 0;
         if ( !mFetchScope.externalPayloadSupported() && partIsExternal ) { //external payload not supported by the client, translate the data
-          data = PartHelper::translateData( data, partIsExternal );
+          const QString fileName = PartHelper::resolveAbsolutePath( data );
+          const QFileInfo fileInfo( fileName );
+          if ( mConnection->streamExternalPayloads() && mConnection->capabilities().noPayloadPath() && fileInfo.size() > 0 ) {
+            // the file is streamed into the socket when the response is written out
+            streamedFileName = fileName;
+            streamedFileSize = fileInfo.size();
+          } else {
+            data = PartHelper::translateData( data, partIsExternal );
+          }
         }
         int version = partQuery.value( PartQueryVersionColumn ).toInt();
         if ( version != 0 ) { // '0' is the default, so don't send it
@@ -574,7 +765,9 @@ bool FetchHelper::fetchItems( const QByteArray &responseIdentifier )
         if (  mFetchScope.externalPayloadSupported() && partIsExternal ) { // external data and this is supported by the client
           part += " [FILE] ";
         }
-        if ( data.isNull() ) {
+        if ( !streamedFileName.isEmpty() ) {
+          part += " {" + QByteArray::number( streamedFileSize ) + "}\r\n";
+        } else if ( data.isNull() ) {
           part += " NIL";
         } else if ( data.isEmpty() ) {
           part += " \"\"";
@@ -586,10 +779,14 @@ bool FetchHelper::fetchItems( const QByteArray &responseIdentifier )
           }
 
           part += " {" + QByteArray::number( data.length() ) + "}\r\n";
+          part.reserve( part.size() + data.size() );
           part += data;
         }
 
         if ( mFetchScope.requestedParts().contains( partName ) || mFetchScope.fullPayload() || mFetchScope.allAttributes() ) {
+          if ( !streamedFileName.isEmpty() ) {
+            fileLiterals.insert( attributes.size(), qMakePair( streamedFileName, streamedFileSize ) );
+          }
           attributes << part;
         }
 
@@ -608,20 +805,31 @@ bool FetchHelper::fetchItems( const QByteArray &responseIdentifier )
 
     // IMAP protocol violation: should actually be the sequence number
     QByteArray attr = QByteArray::number( pimItemId ) + ' ' + responseIdentifier + " (";
-    attr += ImapParser::join( attributes, " " ) + ')';
+    // assemble the response in a single preallocated buffer, so the (potentially
+    // large) payload parts are not copied once more for joining them
+    int responseSize = attr.size() + attributes.size();
+    Q_FOREACH ( const QByteArray &attribute, attributes ) {
+      responseSize += attribute.size();
+    }
+    attr.reserve( responseSize );
+    Response response;
+    for ( int i = 0; i < attributes.size(); ++i ) {
+      if ( i > 0 ) {
+        attr += ' ';
+      }
+      attr += attributes.at( i );
+      if ( fileLiterals.contains( i ) ) {
+        const QPair<QString, qint64> file = fileLiterals.value( i );
+        response.addFileLiteral( attr.size(), file.first, file.second );
+      }
+    }
+    attr += ')';
     response.setUntagged();
     response.setString( attr );
     Q_EMIT responseAvailable( response );
 
     itemQuery.next();
   }
-
-  // update atime (only if the payload was actually requested, otherwise a simple resource sync prevents cache clearing)
-  if ( needsAccessTimeUpdate( mFetchScope.requestedParts() ) || mFetchScope.fullPayload() ) {
-    updateItemAccessTime();
-  }
-
-  return true;
 }
 
 bool FetchHelper::needsAccessTimeUpdate( const QVector<QByteArray> &parts )
@@ -20,6 +20,7 @@
 #ifndef AKONADI_FETCHHELPER_H
 #define AKONADI_FETCHHELPER_H
 
+#include <QtCore/QSet>
 #include <QtCore/QStack>
 
 #include "fetchscope.h"
@@ -68,22 +69,26 @@ class FetchHelper : public QObject
     void updateItemAccessTime();
     void triggerOnDemandFetch();
     QSqlQuery buildItemQuery();
+    void sendItems( QSqlQuery &itemQuery, const QByteArray &responseIdentifier, const QSet<qint64> &skippedItems );
+    QString retrievalErrorMessage( const QString &error ) const;
     QSqlQuery buildPartQuery( const QVector<QByteArray> &partList, bool allPayload, bool allAttrs );
     QSqlQuery buildFlagQuery();
     QSqlQuery buildTagQuery();
     QSqlQuery buildVRefQuery();
+    QSqlQuery buildRelationQuery();
     QStack<Collection> ancestorsForItem( Collection::Id parentColId );
     static bool needsAccessTimeUpdate( const QVector<QByteArray> &parts );
     QVariant extractQueryResult( const QSqlQuery &query, ItemQueryColumns column ) const;
     bool isScopeLocal( const Scope &scope );
-    static QByteArray tagsToByteArray(const Tag::List &tags);
-    static QByteArray relationsToByteArray(const Relation::List &relations);
+    void loadTagDictionary( QSqlQuery &itemTagQuery );
 
   private:
     ImapStreamParser *mStreamParser;
 
     Connection *mConnection;
     QHash<Collection::Id, QStack<Collection> > mAncestorCache;
+    // serialized tags by tag ID, loaded once per fetch
+    QHash<qint64, QByteArray> mTagDictionary;
     Scope mScope;
     FetchScope mFetchScope;
     int mItemQueryColumnMap[ItemQueryColumnCount];
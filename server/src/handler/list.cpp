@@ -85,6 +85,24 @@ QStack<Collection> List::ancestorsForCollection(const Collection &col)
     return ancestors;
 }
 
+Collection List::collectionById(Collection::Id id) const
+{
+    auto it = mCollections.constFind(id);
+    if (it != mCollections.constEnd()) {
+        return it.value();
+    }
+    auto treeIt = mTree.constFind(id);
+    if (treeIt != mTree.constEnd()) {
+        return treeIt.value();
+    }
+    auto ancestorIt = mAncestors.constFind(id);
+    if (ancestorIt != mAncestors.constEnd()) {
+        return ancestorIt.value();
+    }
+    //Not part of the tree we loaded, hopefully the entity cache knows it
+    return Collection::retrieveById(id);
+}
+
 CollectionAttribute::List List::getAttributes(const Collection &col, const QVector<QByteArray> &filter)
 {
     CollectionAttribute::List attributes;
@@ -128,9 +146,9 @@ void List::listCollection(const Collection &root, const QStack<Collection> &ance
     }
 
     // write out collection details
+    //Recursive listings resolve the inherited policy from the loaded tree
     Collection dummy = root;
-    DataStore *db = connection()->storageBackend();
-    db->activeCachePolicy(dummy);
+    DataStore::self()->activeCachePolicy(dummy, mTree);
     const QByteArray b = HandlerHelper::collectionToByteArray(dummy, attributes, mIncludeStatistics, mAncestorDepth, ancestors, ancestorAttributes, isReferencedFromSession || resourceIsSynchronizing, mimeTypes);
 
     Response response;
@@ -222,6 +240,36 @@ void List::retrieveAttributes(const QVariantList &collectionIds)
     }
 }
 
+void List::retrieveTree(const Collection &topParent)
+{
+    //Collections always belong to the same resource as their parent, so the whole tree
+    //above and below the listed collections is contained in the collections of their resources.
+    QVariantList resourceIds;
+    if (topParent.isValid()) {
+        resourceIds << topParent.resourceId();
+    } else {
+        QSet<qint64> resources;
+        Q_FOREACH (const Collection &col, mCollections) {
+            resources.insert(col.resourceId());
+        }
+        Q_FOREACH (qint64 id, resources) {
+            resourceIds << id;
+        }
+    }
+    if (resourceIds.isEmpty()) {
+        return;
+    }
+
+    SelectQueryBuilder<Collection> qb;
+    qb.addValueCondition(Collection::resourceIdFullColumnName(), Query::In, resourceIds);
+    if (!qb.exec()) {
+        throw HandlerException("Unable to retrieve collection tree for listing");
+    }
+    Q_FOREACH (const Collection &col, qb.result()) {
+        mTree.insert(col.id(), col);
+    }
+}
+
 static QSqlQuery getMimeTypeQuery(const QVariantList &ids)
 {
     QueryBuilder qb(CollectionMimeTypeRelation::tableName());
@@ -254,6 +302,10 @@ void List::retrieveCollections(const Collection &topParent, int depth)
      * Mimetypes and attributes are also retrieved in single queries to avoid spawning two queries per collection (the N+1 problem).
      * Note that we're not querying attributes and mimetypes for the collections that are only included to complete the tree,
      * this results in no items being queried for those collections.
+     *
+     * For recursive listings the unfiltered collection tree of the involved resources is loaded in one additional query
+     * (unless the first query already returned it), so linking collections to the top parent, completing the tree and
+     * resolving ancestors and cache policies doesn't need any per-collection queries.
      */
 
     const qint64 parentId = topParent.isValid() ? topParent.id() : 0;
@@ -314,6 +366,19 @@ void List::retrieveCollections(const Collection &topParent, int depth)
         }
     }
 
+    if (depth > 1) {
+        const bool filtered = mCollectionsToSynchronize || mCollectionsToDisplay || mCollectionsToIndex
+                              || mEnabledCollections || mResource.isValid() || !mMimeTypes.isEmpty();
+        if (filtered) {
+            retrieveTree(topParent);
+        } else {
+            //Without filters we already got the complete tree, but we'll remove the collections outside of it below
+            Q_FOREACH (const Collection &col, mCollections) {
+                mTree.insert(col.id(), col);
+            }
+        }
+    }
+
     //Post filtering that we couldn't do as part of the sql query
     if (depth > 0) {
         auto it = mCollections.begin();
@@ -329,11 +394,7 @@ void List::retrieveCollections(const Collection &topParent, int depth)
                         foundParent = true;
                         break;
                     }
-                    Collection col = mCollections.value(id);
-                    if (!col.isValid()) {
-                        col = Collection::retrieveById(id);
-                    }
-                    id = col.parentId();
+                    id = collectionById(id).parentId();
                 }
                 if (!foundParent) {
                     it = mCollections.erase(it);
@@ -383,47 +444,32 @@ void List::retrieveCollections(const Collection &topParent, int depth)
             if (parent.parentId() == 0) {
                 break;
             }
-            parent = parent.parent();
+            parent = collectionById(parent.parentId());
             mAncestors.insert(parent.id(), parent);
             //We also require the attributes
             ancestorIds << parent.id();
         }
     }
 
-    QSet<qint64> missingCollections;
+    //Add missing collections that are part of the tree
     if (depth > 0) {
+        QHash<qint64, Collection> missingCollections;
         Q_FOREACH (const Collection &col, mCollections) {
-            if (col.parentId() != parentId && !mCollections.contains(col.parentId())) {
-                missingCollections.insert(col.parentId());
+            Collection::Id id = col.parentId();
+            while (id > 0 && id != parentId && !mCollections.contains(id) && !missingCollections.contains(id)) {
+                const Collection missingCol = collectionById(id);
+                if (!missingCol.isValid()) {
+                    break;
+                }
+                missingCollections.insert(id, missingCol);
+                id = missingCol.parentId();
             }
         }
-    }
-
-    // qDebug() << "HAS:" << knownIds;
-    // qDebug() << "MISSING:" << missingCollections;
 
-    //Fetch missing collections that are part of the tree
-    while (!missingCollections.isEmpty()) {
-        SelectQueryBuilder<Collection> qb;
-        QVariantList ids;
-        ids.reserve(missingCollections.size());
-        Q_FOREACH (qint64 id, missingCollections) {
-            ids << id;
-        }
-        qb.addValueCondition(Collection::idFullColumnName(), Query::In, ids);
-        if (!qb.exec()) {
-            throw HandlerException("Unable to retrieve collections for listing");
-        }
-
-        missingCollections.clear();
-        Q_FOREACH (const Collection &missingCol, qb.result()) {
+        Q_FOREACH (const Collection &missingCol, missingCollections) {
             mCollections.insert(missingCol.id(), missingCol);
             ancestorIds << missingCol.id();
             attributeIds << missingCol.id();
-            //We have to do another round if the parents parent is missing
-            if (missingCol.parentId() != parentId && !mCollections.contains(missingCol.parentId())) {
-                missingCollections.insert(missingCol.parentId());
-            }
         }
     }
 
@@ -101,6 +101,8 @@ class List : public Handler
                                    const Collection &col);
     CollectionAttribute::List getAttributes(const Collection &colId, const QVector<QByteArray> &filter = QVector<QByteArray>());
     void retrieveAttributes(const QVariantList &collectionIds);
+    void retrieveTree(const Collection &topParent);
+    Collection collectionById(Collection::Id id) const;
 
   private:
     Resource mResource;
@@ -116,6 +118,7 @@ class List : public Handler
     QVector<QByteArray> mAncestorAttributes;
     QMap<qint64 /*id*/, Collection> mCollections;
     QHash<qint64 /*id*/, Collection> mAncestors;
+    QHash<qint64 /*id*/, Collection> mTree;
     QMultiHash<qint64 /*collectionId*/, CollectionAttribute /*mimetypeId*/> mCollectionAttributes;
 };
 
@@ -30,6 +30,7 @@
 #include <storage/selectquerybuilder.h>
 #include <storage/transaction.h>
 #include <storage/collectionqueryhelper.h>
+#include <libs/imapset_p.h>
 
 using namespace Akonadi::Server;
 
@@ -65,79 +66,98 @@ bool Move::parseStream()
 
   CacheCleanerInhibitor inhibitor;
 
-  // make sure all the items we want to move are in the cache
-  ItemRetriever retriever( connection() );
-  retriever.setScope( mScope );
-  retriever.setRetrieveFullPayload( true );
-  if ( !retriever.exec() ) {
-    return failureResponse( retriever.lastError() );
-  }
-
-  DataStore *store = connection()->storageBackend();
-  Transaction transaction( store );
-
   SelectQueryBuilder<PimItem> qb;
   ItemQueryHelper::scopeToQuery( mScope, connection()->context(), qb );
   qb.addValueCondition( PimItem::collectionIdFullColumnName(), Query::NotEquals, destination.id() );
+  if ( !qb.exec() ) {
+    throw HandlerException( "Unable to execute query" );
+  }
+  const QVector<PimItem> items = qb.result();
+  qb.query().finish();
+  if ( items.isEmpty() ) {
+    throw HandlerException( "No items found" );
+  }
 
-  const QDateTime mtime = QDateTime::currentDateTime();
-
-  if ( qb.exec() ) {
-    const QVector<PimItem> items = qb.result();
-    if ( items.isEmpty() ) {
-      throw HandlerException( "No items found" );
+  // Split the list by source collection
+  QMap<Entity::Id /* collection */, PimItem::List> toMove;
+  Q_FOREACH ( const PimItem &item, items ) {
+    if ( !item.isValid() ) {
+      throw HandlerException( "Invalid item in result set!?" );
     }
+    Q_ASSERT( item.collectionId() != destination.id() );
+    toMove[item.collectionId()] << item;
+  }
 
-    // Split the list by source collection
-    QMap<Entity::Id /* collection */, PimItem> toMove;
-    QMap<Entity::Id /* collection */, Collection> sources;
-    Q_FOREACH ( /*sic!*/ PimItem item, items ) {
-      const Collection source = items.first().collection();
-      if ( !source.isValid() ) {
-        throw HandlerException( "Item without collection found!?" );
+  QMap<Entity::Id /* collection */, Collection> sources;
+  QVector<Entity::Id> interResourceItems;
+  for ( QMap<Entity::Id, PimItem::List>::ConstIterator it = toMove.constBegin(); it != toMove.constEnd(); ++it ) {
+    const Collection source = Collection::retrieveById( it.key() );
+    if ( !source.isValid() ) {
+      throw HandlerException( "Item without collection found!?" );
+    }
+    sources.insert( source.id(), source );
+    if ( source.resourceId() != destResource.id() ) {
+      Q_FOREACH ( const PimItem &item, it.value() ) {
+        interResourceItems << item.id();
       }
-      if ( !sources.contains( source.id() ) ) {
-        sources.insert( source.id(), source );
+    }
+  }
+
+  // make sure all the items we want to move to another resource are in the cache,
+  // items staying in their resource don't need their payload
+  if ( !interResourceItems.isEmpty() ) {
+    ImapSet set;
+    set.add( interResourceItems );
+    ItemRetriever retriever( connection() );
+    retriever.setItemSet( set );
+    retriever.setRetrieveFullPayload( true );
+    if ( !retriever.exec() ) {
+      return failureResponse( retriever.lastError() );
+    }
+  }
+
+  DataStore *store = connection()->storageBackend();
+  Transaction transaction( store );
+
+  const QDateTime mtime = QDateTime::currentDateTime();
+  // if the resource moved itself, we assume it did so because the change happend in the backend
+  const bool markDirty = connection()->context()->resource().id() != destResource.id();
+
+  // Emit notification and update the items for each source collection separately
+  for ( QMap<Entity::Id, PimItem::List>::ConstIterator it = toMove.constBegin(); it != toMove.constEnd(); ++it ) {
+    const Collection &source = sources.value( it.key() );
+    const PimItem::List &itemsToMove = it.value();
+    store->notificationCollector()->itemsMoved( itemsToMove, source, destination );
+
+    // reset RID on inter-resource moves, but only after generating the change notification
+    // so that this still contains the old one for the source resource
+    const bool isInterResourceMove = source.resourceId() != destResource.id();
+
+    // Update the items in chunks, because something can't handle queries with more than 999 bound values,
+    // leave room for the column values
+    const int chunkSize = 990;
+    for ( int start = 0; start < itemsToMove.size(); start += chunkSize ) {
+      QVariantList ids;
+      const int end = qMin( start + chunkSize, itemsToMove.size() );
+      for ( int i = start; i < end; ++i ) {
+        ids << itemsToMove.at( i ).id();
       }
 
-      if ( !item.isValid() ) {
-        throw HandlerException( "Invalid item in result set!?" );
+      QueryBuilder updateQb( PimItem::tableName(), QueryBuilder::Update );
+      updateQb.setColumnValue( PimItem::collectionIdColumn(), destination.id() );
+      updateQb.setColumnValue( PimItem::atimeColumn(), mtime );
+      updateQb.setColumnValue( PimItem::datetimeColumn(), mtime );
+      if ( markDirty ) {
+        updateQb.setColumnValue( PimItem::dirtyColumn(), true );
       }
-      Q_ASSERT( item.collectionId() != destination.id() );
-
-      item.setCollectionId( destination.id() );
-      item.setAtime( mtime );
-      item.setDatetime( mtime );
-      // if the resource moved itself, we assume it did so because the change happend in the backend
-      if ( connection()->context()->resource().id() != destResource.id() ) {
-        item.setDirty( true );
+      if ( isInterResourceMove ) {
+        updateQb.setColumnValue( PimItem::remoteIdColumn(), QString() );
       }
-
-      toMove.insertMulti( source.id(), item );
-    }
-
-    // Emit notification for each source collection separately
-    Q_FOREACH ( const Entity::Id &sourceId, toMove.uniqueKeys() ) {
-      const PimItem::List &itemsToMove = toMove.values( sourceId ).toVector();
-      const Collection &source = sources.value( sourceId );
-      store->notificationCollector()->itemsMoved( itemsToMove, source, destination );
-
-      Q_FOREACH ( PimItem moved, toMove.values( sourceId ) ) {
-        // reset RID on inter-resource moves, but only after generating the change notification
-        // so that this still contains the old one for the source resource
-        const bool isInterResourceMove = moved.collection().resource().id() != source.resource().id();
-        if ( isInterResourceMove ) {
-          moved.setRemoteId( QString() );
-        }
-
-        // FIXME Could we aggregate the changes to a single SQL query?
-        if ( !moved.update() ) {
-          throw HandlerException( "Unable to update item" );
-        }
+      updateQb.addValueCondition( PimItem::idColumn(), Query::In, ids );
+      if ( !updateQb.exec() ) {
+        throw HandlerException( "Unable to update items" );
       }
     }
-  } else {
-    throw HandlerException( "Unable to execute query" );
   }
 
   if ( !transaction.commit() ) {
@@ -23,6 +23,7 @@
 #include "akonadi.h"
 #include "connection.h"
 #include "storage/datastore.h"
+#include "storage/collectionstatistics.h"
 #include "storage/entity.h"
 #include "handlerhelper.h"
 #include "imapstreamparser.h"
@@ -96,19 +97,17 @@ bool Select::parseStream()
     response.setString( "FLAGS (" + Flag::joinByName( Flag::retrieveAll(), QLatin1String( " " ) ).toLatin1() + ")" );
     Q_EMIT responseAvailable( response );
 
-    const int itemCount = HandlerHelper::itemCount( col );
-    if ( itemCount < 0 ) {
+    CollectionStatistics::Statistics stats;
+    if ( !CollectionStatistics::self()->statistics( col, stats ) ) {
       return failureResponse( "Unable to determine item count" );
     }
-    response.setString( QByteArray::number( itemCount ) + " EXISTS" );
+    response.setString( QByteArray::number( stats.count ) + " EXISTS" );
     Q_EMIT responseAvailable( response );
 
-    int readCount = HandlerHelper::itemWithFlagsCount( col, QStringList() << QLatin1String( AKONADI_FLAG_SEEN )
-                                                                          << QLatin1String( AKONADI_FLAG_IGNORED ) );
-    if ( readCount < 0 || itemCount < readCount ) {
+    if ( stats.count < stats.read ) {
       return failureResponse( "Unable to retrieve unseen count" );
     }
-    response.setString( "OK [UNSEEN " + QByteArray::number( itemCount - readCount ) + "] Message 0 is first unseen" );
+    response.setString( "OK [UNSEEN " + QByteArray::number( stats.count - stats.read ) + "] Message 0 is first unseen" );
     Q_EMIT responseAvailable( response );
   }
 
@@ -21,6 +21,7 @@
 #include "imapstreamparser.h"
 #include "storage/countquerybuilder.h"
 #include "storage/datastore.h"
+#include "storage/collectionstatistics.h"
 #include "storage/selectquerybuilder.h"
 #include "storage/queryhelper.h"
 #include "libs/imapparser_p.h"
@@ -235,14 +236,12 @@ QByteArray HandlerHelper::collectionToByteArray( const Collection &col, const Co
   b += " " AKONADI_PARAM_VIRTUAL " " + QByteArray::number( col.isVirtual() ) + ' ';
 
   if ( includeStatistics ) {
-    qint64 itemCount, itemSize;
-    if ( itemStatistics( col, itemCount, itemSize ) ) {
-      b += AKONADI_ATTRIBUTE_MESSAGES " " + QByteArray::number( itemCount ) + ' ';
-      // itemWithFlagCount is twice as fast as itemWithoutFlagCount, so emulated that...
+    CollectionStatistics::Statistics stats;
+    if ( CollectionStatistics::self()->statistics( col, stats ) ) {
+      b += AKONADI_ATTRIBUTE_MESSAGES " " + QByteArray::number( stats.count ) + ' ';
       b += AKONADI_ATTRIBUTE_UNSEEN " ";
-      b += QByteArray::number( itemCount - itemWithFlagsCount( col, QStringList() << QLatin1String( AKONADI_FLAG_SEEN )
-                                                                                  << QLatin1String( AKONADI_FLAG_IGNORED ) ) );
-      b += " " AKONADI_PARAM_SIZE " " + QByteArray::number( itemSize ) + ' ';
+      b += QByteArray::number( stats.count - stats.read );
+      b += " " AKONADI_PARAM_SIZE " " + QByteArray::number( stats.size ) + ' ';
     }
   }
 
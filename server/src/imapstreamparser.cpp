@@ -25,12 +25,46 @@
 #include <QtCore/QDateTime>
 #include <QtCore/QDebug>
 #include <ctype.h>
+#include <limits>
 #include <QtNetwork/QLocalSocket>
 #include <QIODevice>
 
 using namespace Akonadi;
 using namespace Akonadi::Server;
 
+// Maximum size of the literal parts handed out by readLiteralPart()
+static const qint64 s_maxLiteralPartSize = 1024 * 1024;
+
+// Consumed data is only removed from the parse buffer once it exceeds this size
+// and makes up at least half of the buffer, so that the unread data is not moved
+// around after every token
+static const int s_minCompactSize = 64 * 1024;
+
+static qint64 parseNumber( const char *begin, const char *end, bool *ok )
+{
+  bool negative = false;
+  if ( begin < end && *begin == '-' ) {
+    negative = true;
+    ++begin;
+  }
+
+  *ok = begin < end;
+  qint64 result = 0;
+  for ( ; begin < end; ++begin ) {
+    if ( !isdigit( *begin ) ) {
+      *ok = false;
+      return 0;
+    }
+    const int digit = *begin - '0';
+    if ( result > ( std::numeric_limits<qint64>::max() - digit ) / 10 ) {
+      *ok = false;
+      return 0;
+    }
+    result = result * 10 + digit;
+  }
+  return negative ? -result : result;
+}
+
 ImapStreamParser::ImapStreamParser( QIODevice *socket )
   : m_socket( socket )
   , m_position( 0 )
@@ -135,7 +169,8 @@ bool ImapStreamParser::hasLiteral( bool requestData )
       }
     } while ( end == -1 );
     Q_ASSERT( end > m_position );
-    m_literalSize = m_data.mid( m_position + 1, end - m_position - 1 ).toInt();
+    bool ok = false;
+    m_literalSize = parseNumber( m_data.constData() + m_position + 1, m_data.constData() + end, &ok );
     // strip CRLF
     m_position = end + 1;
 
@@ -166,25 +201,40 @@ qint64 ImapStreamParser::remainingLiteralSize()
 
 QByteArray ImapStreamParser::readLiteralPart()
 {
-  static qint64 maxLiteralPartSize = 4096;
-  int size = qMin( maxLiteralPartSize, m_literalSize );
+  QByteArray result;
 
-  if ( !waitForMoreData( m_data.length() < m_position + size ) ) {
-       throw ImapParserException( "Unable to read more data" );
+  if ( m_position >= m_data.length() && m_literalSize > 0 && !m_peeking ) {
+    // Nothing buffered anymore, hand out the data as read from the socket instead of
+    // appending it to the parse buffer first
+    compactBuffer();
+    if ( !waitForMoreData( true ) ) {
+      throw ImapParserException( "Unable to read more data" );
+    }
+    // waitForMoreData() appended to the (empty) buffer without copying, take it back
+    if ( m_data.length() <= m_literalSize ) {
+      result = m_data;
+      m_data.clear();
+    } else {
+      result = m_data.left( static_cast<int>( m_literalSize ) );
+      m_position = result.size();
+      compactBuffer();
+    }
+    m_literalSize -= result.size();
+    return result;
   }
 
-  if ( m_data.length() < m_position + size ) { // Still not enough data
-    // Take what's already there
-    size = m_data.length() - m_position;
+  if ( !waitForMoreData( m_literalSize > 0 && m_position >= m_data.length() ) ) {
+    throw ImapParserException( "Unable to read more data" );
   }
 
-  QByteArray result = m_data.mid( m_position, size );
+  // Take what's already there
+  const int size = qMin( qMin( s_maxLiteralPartSize, m_literalSize ), qint64( m_data.length() - m_position ) );
+  result = m_data.mid( m_position, size );
   m_position += size;
   m_literalSize -= size;
   Q_ASSERT( m_literalSize >= 0 );
   if ( !m_peeking ) {
-    m_data = m_data.right( m_data.size() - m_position );
-    m_position = 0;
+    compactBuffer();
   }
   return result;
 }
@@ -674,9 +724,8 @@ qint64 ImapStreamParser::readNumber( bool *ok )
     }
     ++i;
   }
-  const QByteArray tmp = m_data.mid( m_position, i - m_position );
   bool success = false;
-  result = tmp.toLongLong( &success );
+  result = parseNumber( m_data.constData() + m_position, m_data.constData() + i, &success );
   if ( ok ) {
     *ok = success;
   } else if ( !success ) {
@@ -697,6 +746,17 @@ void ImapStreamParser::stripLeadingSpaces()
   m_position = m_data.length();
 }
 
+void ImapStreamParser::compactBuffer()
+{
+  if ( m_position >= m_data.length() ) {
+    m_data.clear();
+    m_position = 0;
+  } else if ( m_position >= s_minCompactSize && m_position >= m_data.length() / 2 ) {
+    m_data.remove( 0, m_position );
+    m_position = 0;
+  }
+}
+
 bool ImapStreamParser::waitForMoreData( bool wait )
 {
    if ( wait ) {
@@ -720,6 +780,11 @@ QByteArray ImapStreamParser::readRemainingData()
   return m_data.mid( m_position );
 }
 
+bool ImapStreamParser::hasRemainingData() const
+{
+  return m_position < m_data.length();
+}
+
 bool ImapStreamParser::atCommandEnd()
 {
   if ( !waitForMoreData( m_position >= m_data.length() ) ) {
@@ -736,8 +801,7 @@ bool ImapStreamParser::atCommandEnd()
     }
     // We'd better empty m_data from time to time before it grows out of control
     if ( !m_peeking ) {
-      m_data = m_data.right( m_data.size() - m_position );
-      m_position = 0;
+      compactBuffer();
     }
     return true; //command end
   }
@@ -763,6 +827,10 @@ QByteArray ImapStreamParser::readUntilCommandEnd()
       while ( !atLiteralEnd() ) {
         result.append( readLiteralPart() );
       }
+      // literal data is not necessarily followed by buffered data anymore
+      if ( !waitForMoreData( m_position >= m_data.length() ) ) {
+        throw ImapParserException( "Unable to read more data" );
+      }
       // Read the last character part and possible crlf
       i = m_position;
       do {
@@ -798,8 +866,7 @@ QByteArray ImapStreamParser::readUntilCommandEnd()
   m_position = i + 1;
   // We'd better empty m_data from time to time before it grows out of control
   if ( !m_peeking ) {
-    m_data = m_data.right( m_data.size() - m_position );
-    m_position = 0;
+    compactBuffer();
   }
   return result;
 }
@@ -820,8 +887,7 @@ void ImapStreamParser::skipCurrentCommand()
   m_position = i + 1;
   // We'd better empty m_data from time to time before it grows out of control
   if ( !m_peeking ) {
-    m_data = m_data.right( m_data.size() - m_position );
-    m_position = 0;
+    compactBuffer();
   }
 }
 
@@ -228,6 +228,12 @@ class ImapStreamParser
      */
     QByteArray readRemainingData();
 
+    /**
+     * Returns whether there is data that was read from the socket, but not processed yet.
+     * Unlike readRemainingData() this does not copy the data.
+     */
+    bool hasRemainingData() const;
+
     void setData( const QByteArray &data );
 
     /**
@@ -269,6 +275,12 @@ class ImapStreamParser
      */
     bool waitForMoreData( bool wait );
 
+    /**
+     * Removes the already processed data from the parse buffer, if it is worth it.
+     * Must not be called while peeking.
+     */
+    void compactBuffer();
+
     QIODevice *m_socket;
     QByteArray m_data;
     QByteArray m_tag;
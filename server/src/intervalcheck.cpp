@@ -49,13 +49,6 @@ int IntervalCheck::collectionScheduleInterval( const Collection &collection )
   return collection.cachePolicyCheckInterval();
 }
 
-bool IntervalCheck::hasChanged( const Collection &collection, const Collection &changed )
-{
-  return collection.cachePolicyCheckInterval() != changed.cachePolicyCheckInterval()
-        || collection.enabled() != changed.enabled()
-        || collection.syncPref() != changed.syncPref();
-}
-
 bool IntervalCheck::shouldScheduleCollection( const Collection &collection )
 {
   return collection.cachePolicyCheckInterval() > 0
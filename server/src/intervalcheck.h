@@ -49,7 +49,6 @@ class IntervalCheck : public CollectionScheduler
 
   protected:
     int collectionScheduleInterval( const Collection &collection );
-    bool hasChanged( const Collection &collection, const Collection &changed );
     bool shouldScheduleCollection( const Collection &collection );
 
   protected Q_SLOTS:
@@ -38,8 +38,51 @@ using namespace Akonadi::Server;
 
 NotificationManager *NotificationManager::mSelf = 0;
 
+template <typename List>
+static List selectNotifications( const List &notifications, const QVector<int> &indexes )
+{
+  List selection;
+  selection.reserve( indexes.count() );
+  Q_FOREACH ( int index, indexes ) {
+    selection << notifications.at( index );
+  }
+  return selection;
+}
+
+/**
+ * Splits the notifications into several signals if there are more than
+ * @p maxBatchSize of them, so that slow subscribers don't choke on a huge
+ * D-Bus message.
+ */
+template <typename List>
+static void emitNotifications( NotificationSource *source, const List &notifications, int maxBatchSize )
+{
+  if ( maxBatchSize <= 0 || notifications.count() <= maxBatchSize ) {
+    source->emitNotification( notifications );
+    return;
+  }
+
+  for ( int i = 0; i < notifications.count(); i += maxBatchSize ) {
+    source->emitNotification( notifications.mid( i, maxBatchSize ) );
+  }
+}
+
+// Batches up to this size are delivered right away when no notifications
+// have been emitted for a while
+static const int s_interactiveBatchSize = 10;
+// The flush interval grows while batches reach this size, and shrinks again
+// when they become ten times smaller
+static const int s_largeBatchSize = 1000;
+
 NotificationManager::NotificationManager()
   : QObject( 0 )
+  , mSubscriptionIndexDirty( true )
+  , mFlushCount( 0 )
+  , mEmittedCount( 0 )
+  , mLastBatchSize( 0 )
+  , mLastFlushLatency( 0 )
+  , mMaxFlushLatency( 0 )
+  , mTotalFlushLatency( 0 )
 {
   NotificationMessage::registerDBusTypes();
   NotificationMessageV2::registerDBusTypes();
@@ -54,7 +97,12 @@ NotificationManager::NotificationManager()
   const QString serverConfigFile = AkStandardDirs::serverConfigFile( XdgBaseDirs::ReadWrite );
   QSettings settings( serverConfigFile, QSettings::IniFormat );
 
-  mTimer.setInterval( settings.value( QLatin1String( "NotificationManager/Interval" ), 50 ).toInt() );
+  mBaseInterval = settings.value( QLatin1String( "NotificationManager/Interval" ), 50 ).toInt();
+  mMaxInterval = qMax( mBaseInterval, settings.value( QLatin1String( "NotificationManager/MaxInterval" ), 1000 ).toInt() );
+  mMaxQueueSize = settings.value( QLatin1String( "NotificationManager/MaxQueueSize" ), 50000 ).toInt();
+  mMaxBatchSize = settings.value( QLatin1String( "NotificationManager/MaxBatchSize" ), 5000 ).toInt();
+  mInterval = mBaseInterval;
+
   mTimer.setSingleShot( true );
   connect( &mTimer, SIGNAL(timeout()), SLOT(emitPendingNotifications()) );
 }
@@ -80,25 +128,39 @@ void NotificationManager::connectNotificationCollector( NotificationCollector *c
 
 void NotificationManager::slotNotify( const Akonadi::NotificationMessageV3::List &msgs )
 {
-  //akDebug() << Q_FUNC_INFO << "Appending" << msgs.count() << "notifications to current list of " << mNotifications.count() << "notifications";
-  Q_FOREACH ( const NotificationMessageV3 &msg, msgs )
-    NotificationMessageV3::appendAndCompress( mNotifications, msg );
-  //akDebug() << Q_FUNC_INFO << "We have" << mNotifications.count() << "notifications queued in total after appendAndCompress()";
+  if ( mPendingNotifications.isEmpty() ) {
+    mQueueTime.start();
+  }
+  Q_FOREACH ( const NotificationMessageV3 &msg, msgs ) {
+    mPendingNotifications.append( msg );
+  }
 
-  if ( !mTimer.isActive() ) {
-    mTimer.start();
+  const int pending = mPendingNotifications.count();
+  if ( mMaxQueueSize > 0 && pending >= mMaxQueueSize ) {
+    // don't let the queue grow without bounds during large imports
+    mTimer.start( 0 );
+  } else if ( !mTimer.isActive() ) {
+    // a small change after an idle period is most likely interactive,
+    // deliver it with the next event loop iteration
+    const bool idle = !mLastFlush.isValid() || mLastFlush.elapsed() >= mInterval;
+    mTimer.start( ( idle && pending <= s_interactiveBatchSize ) ? 0 : mInterval );
   }
 }
 
 void NotificationManager::emitPendingNotifications()
 {
+  mNotifications = mPendingNotifications.takeNotifications();
   if ( mNotifications.isEmpty() ) {
     return;
   }
+  const int queueLatency = mQueueTime.elapsed();
 
+  const bool traceNotifications = Tracer::self()->isEnabled();
   NotificationMessage::List legacyNotifications;
   Q_FOREACH ( const NotificationMessageV3 &notification, mNotifications ) {
-    Tracer::self()->signal( "NotificationManager::notify", notification.toString() );
+    if ( traceNotifications ) {
+      Tracer::self()->signal( "NotificationManager::notify", notification.toString() );
+    }
 
     if ( ClientCapabilityAggregator::minimumNotificationMessageVersion() < 2 ) {
       const NotificationMessage::List tmp = notification.toNotificationV1().toList();
@@ -114,39 +176,38 @@ void NotificationManager::emitPendingNotifications()
 
   if ( !legacyNotifications.isEmpty() ) {
     Q_FOREACH ( NotificationSource *src, mNotificationSources ) {
-      src->emitNotification( legacyNotifications );
+      emitNotifications( src, legacyNotifications, mMaxBatchSize );
     }
   }
 
 
+  const int maximumVersion = ClientCapabilityAggregator::maximumNotificationMessageVersion();
   NotificationMessageV2::List v2List;
-  if ( ClientCapabilityAggregator::maximumNotificationMessageVersion() == 2 ) {
+  if ( maximumVersion == 2 ) {
     v2List = NotificationMessageV3::toV2List( mNotifications );
   }
 
-  if ( ClientCapabilityAggregator::maximumNotificationMessageVersion() > 1 ) {
+  if ( maximumVersion > 1 ) {
+    const QHash<NotificationSource *, QVector<int> > routedNotifications = routeNotifications();
     Q_FOREACH ( NotificationSource *source, mNotificationSources ) {
-      if ( !source->isServerSideMonitorEnabled() ) {
-        if ( ClientCapabilityAggregator::maximumNotificationMessageVersion() == 2 ) {
-          source->emitNotification( v2List );
-        } else {
-          source->emitNotification( mNotifications );
-        }
+      const QVector<int> accepted = routedNotifications.value( source );
+      if ( source->isServerSideMonitorEnabled() && accepted.isEmpty() ) {
         continue;
       }
 
-      NotificationMessageV3::List acceptedNotifications;
-      Q_FOREACH ( const NotificationMessageV3 &notification, mNotifications ) {
-        if ( source->acceptsNotification( notification ) ) {
-          acceptedNotifications << notification;
+      // Sources receiving the whole batch share the pending list, the others
+      // get a selection of the notifications that have been converted once
+      if ( maximumVersion == 2 ) {
+        if ( !source->isServerSideMonitorEnabled() || accepted.count() == v2List.count() ) {
+          emitNotifications( source, v2List, mMaxBatchSize );
+        } else {
+          emitNotifications( source, selectNotifications( v2List, accepted ), mMaxBatchSize );
         }
-      }
-
-      if ( !acceptedNotifications.isEmpty() ) {
-        if ( ClientCapabilityAggregator::maximumNotificationMessageVersion() == 2 ) {
-          source->emitNotification( NotificationMessageV3::toV2List( acceptedNotifications ) );
+      } else {
+        if ( !source->isServerSideMonitorEnabled() || accepted.count() == mNotifications.count() ) {
+          emitNotifications( source, mNotifications, mMaxBatchSize );
         } else {
-          source->emitNotification( acceptedNotifications );
+          emitNotifications( source, selectNotifications( mNotifications, accepted ), mMaxBatchSize );
         }
       }
     }
@@ -158,9 +219,212 @@ void NotificationManager::emitPendingNotifications()
     Q_EMIT notify( legacyNotifications );
   }
 
+  updateFlushStatistics( mNotifications.count(), queueLatency );
   mNotifications.clear();
 }
 
+void NotificationManager::updateFlushStatistics( int batchSize, int queueLatency )
+{
+  ++mFlushCount;
+  mEmittedCount += batchSize;
+  mLastBatchSize = batchSize;
+  mLastFlushLatency = queueLatency;
+  mMaxFlushLatency = qMax( mMaxFlushLatency, queueLatency );
+  mTotalFlushLatency += queueLatency;
+  mLastFlush.start();
+
+  // wait longer during large imports, so that more notifications are compressed
+  // and the subscribers are woken up less often
+  if ( batchSize >= s_largeBatchSize ) {
+    mInterval = qMin( qMax( mInterval, 1 ) * 2, mMaxInterval );
+  } else if ( batchSize < s_largeBatchSize / 10 ) {
+    mInterval = qMax( mInterval / 2, mBaseInterval );
+  }
+}
+
+QVariantMap NotificationManager::statistics() const
+{
+  QVariantMap statistics;
+  statistics.insert( QLatin1String( "pendingNotifications" ), mPendingNotifications.count() );
+  statistics.insert( QLatin1String( "interval" ), mInterval );
+  statistics.insert( QLatin1String( "flushes" ), mFlushCount );
+  statistics.insert( QLatin1String( "emittedNotifications" ), mEmittedCount );
+  statistics.insert( QLatin1String( "lastBatchSize" ), mLastBatchSize );
+  statistics.insert( QLatin1String( "lastFlushLatency" ), mLastFlushLatency );
+  statistics.insert( QLatin1String( "maximumFlushLatency" ), mMaxFlushLatency );
+  statistics.insert( QLatin1String( "averageFlushLatency" ), mFlushCount > 0 ? mTotalFlushLatency / mFlushCount : 0 );
+
+  QVariantMap subscribers;
+  Q_FOREACH ( NotificationSource *source, mNotificationSources ) {
+    QVariantMap subscriber;
+    subscriber.insert( QLatin1String( "deliveredNotifications" ), source->deliveredNotificationsCount() );
+    subscriber.insert( QLatin1String( "deliveredBatches" ), source->deliveredBatchesCount() );
+    subscriber.insert( QLatin1String( "lastDeliveryAge" ), source->lastDeliveryAge() );
+    subscribers.insert( source->identifier(), subscriber );
+  }
+  statistics.insert( QLatin1String( "subscribers" ), subscribers );
+
+  return statistics;
+}
+
+template <typename Key>
+static void addSources( const QHash<Key, QVector<NotificationSource *> > &index, const Key &key,
+                        QSet<NotificationSource *> &candidates )
+{
+  typename QHash<Key, QVector<NotificationSource *> >::const_iterator it = index.constFind( key );
+  if ( it != index.constEnd() ) {
+    Q_FOREACH ( NotificationSource *source, it.value() ) {
+      candidates.insert( source );
+    }
+  }
+}
+
+static void addSources( const QVector<NotificationSource *> &sources, QSet<NotificationSource *> &candidates )
+{
+  Q_FOREACH ( NotificationSource *source, sources ) {
+    candidates.insert( source );
+  }
+}
+
+void NotificationManager::invalidateSubscriptionIndex()
+{
+  mSubscriptionIndexDirty = true;
+}
+
+void NotificationManager::updateSubscriptionIndex()
+{
+  if ( !mSubscriptionIndexDirty ) {
+    return;
+  }
+
+  mSubscriptionIndex = SubscriptionIndex();
+  Q_FOREACH ( NotificationSource *source, mNotificationSources ) {
+    Q_FOREACH ( Entity::Id id, source->monitoredCollections() ) {
+      if ( id == 0 ) {
+        mSubscriptionIndex.allCollections << source;
+      } else {
+        mSubscriptionIndex.collections[id] << source;
+      }
+    }
+    Q_FOREACH ( Entity::Id id, source->monitoredItems() ) {
+      mSubscriptionIndex.items[id] << source;
+    }
+    const QVector<Entity::Id> tags = source->monitoredTags();
+    if ( tags.isEmpty() ) {
+      mSubscriptionIndex.allTags << source;
+    }
+    Q_FOREACH ( Entity::Id id, tags ) {
+      mSubscriptionIndex.tags[id] << source;
+    }
+    Q_FOREACH ( const QByteArray &resource, source->monitoredResources() ) {
+      mSubscriptionIndex.resources[resource] << source;
+    }
+    Q_FOREACH ( const QString &mimeType, source->monitoredMimeTypes() ) {
+      mSubscriptionIndex.mimeTypes[mimeType] << source;
+    }
+  }
+
+  mSubscriptionIndexDirty = false;
+}
+
+bool NotificationManager::collectCandidates( const NotificationMessageV3 &notification,
+                                             QSet<NotificationSource *> &candidates ) const
+{
+  // The candidates must be a superset of the sources accepting the notification,
+  // see NotificationSource::acceptsNotification(), which still does the actual filtering.
+  switch ( notification.type() ) {
+  case NotificationMessageV2::InvalidType:
+    return true;
+
+  case NotificationMessageV2::Items:
+  case NotificationMessageV2::Collections:
+  {
+    // delivery of disabled collections depends on the collection references of each session
+    if ( notification.type() == NotificationMessageV2::Collections && notification.d->metadata.contains( "DISABLED" ) ) {
+      return false;
+    }
+
+    const SubscriptionIndex &index = mSubscriptionIndex;
+    addSources( index.allCollections, candidates );
+    addSources( index.collections, notification.parentCollection(), candidates );
+    addSources( index.collections, notification.parentDestCollection(), candidates );
+    addSources( index.resources, notification.resource(), candidates );
+    if ( notification.operation() == NotificationMessageV2::Move ) {
+      addSources( index.resources, notification.destinationResource(), candidates );
+    }
+    const QMap<Entity::Id, NotificationMessageV2::Entity> entities = notification.entities();
+    QMap<Entity::Id, NotificationMessageV2::Entity>::const_iterator it = entities.constBegin();
+    for ( ; it != entities.constEnd(); ++it ) {
+      if ( notification.type() == NotificationMessageV2::Items ) {
+        addSources( index.items, it.key(), candidates );
+        addSources( index.mimeTypes, it.value().mimeType, candidates );
+      } else {
+        addSources( index.collections, it.key(), candidates );
+      }
+    }
+    return true;
+  }
+
+  case NotificationMessageV2::Tags:
+  {
+    addSources( mSubscriptionIndex.allTags, candidates );
+    const QMap<Entity::Id, NotificationMessageV2::Entity> entities = notification.entities();
+    QMap<Entity::Id, NotificationMessageV2::Entity>::const_iterator it = entities.constBegin();
+    for ( ; it != entities.constEnd(); ++it ) {
+      addSources( mSubscriptionIndex.tags, it.key(), candidates );
+    }
+    return true;
+  }
+
+  case NotificationMessageV2::Relations:
+    return false;
+  }
+
+  return false;
+}
+
+QHash<NotificationSource *, QVector<int> > NotificationManager::routeNotifications()
+{
+  updateSubscriptionIndex();
+
+  // sources monitoring everything and exclusive sources can accept any notification
+  SourceList serverSideSources;
+  SourceList broadSources;
+  Q_FOREACH ( NotificationSource *source, mNotificationSources ) {
+    if ( !source->isServerSideMonitorEnabled() ) {
+      continue;
+    }
+    serverSideSources << source;
+    if ( source->isAllMonitored() || source->isExclusive() ) {
+      broadSources << source;
+    }
+  }
+
+  QHash<NotificationSource *, QVector<int> > routedNotifications;
+  if ( serverSideSources.isEmpty() ) {
+    return routedNotifications;
+  }
+
+  QSet<NotificationSource *> candidates;
+  for ( int i = 0; i < mNotifications.count(); ++i ) {
+    const NotificationMessageV3 &notification = mNotifications.at( i );
+    candidates.clear();
+    if ( collectCandidates( notification, candidates ) ) {
+      addSources( broadSources, candidates );
+    } else {
+      addSources( serverSideSources, candidates );
+    }
+
+    Q_FOREACH ( NotificationSource *source, candidates ) {
+      if ( source->isServerSideMonitorEnabled() && source->acceptsNotification( notification ) ) {
+        routedNotifications[source] << i;
+      }
+    }
+  }
+
+  return routedNotifications;
+}
+
 QDBusObjectPath NotificationManager::subscribeV2( const QString &identifier, bool serverSideMonitor )
 {
   akDebug() << Q_FUNC_INFO << this << identifier << serverSideMonitor;
@@ -197,6 +461,13 @@ QDBusObjectPath NotificationManager::subscribeV3( const QString &identifier, boo
 void NotificationManager::registerSource( NotificationSource *source )
 {
   mNotificationSources.insert( source->identifier(), source );
+
+  connect( source, SIGNAL(monitoredCollectionsChanged()), SLOT(invalidateSubscriptionIndex()), Qt::UniqueConnection );
+  connect( source, SIGNAL(monitoredItemsChanged()), SLOT(invalidateSubscriptionIndex()), Qt::UniqueConnection );
+  connect( source, SIGNAL(monitoredTagsChanged()), SLOT(invalidateSubscriptionIndex()), Qt::UniqueConnection );
+  connect( source, SIGNAL(monitoredResourcesChanged()), SLOT(invalidateSubscriptionIndex()), Qt::UniqueConnection );
+  connect( source, SIGNAL(monitoredMimeTypesChanged()), SLOT(invalidateSubscriptionIndex()), Qt::UniqueConnection );
+  invalidateSubscriptionIndex();
 }
 
 QDBusObjectPath NotificationManager::subscribe( const QString &identifier )
@@ -221,6 +492,8 @@ void NotificationManager::unsubscribe( const QString &identifier )
 void NotificationManager::unregisterSource( NotificationSource *source )
 {
   mNotificationSources.remove( source->identifier() );
+  source->disconnect( this );
+  invalidateSubscriptionIndex();
 }
 
 QStringList NotificationManager::subscribers() const
@@ -22,11 +22,16 @@
 
 #include "../libs/notificationmessage_p.h"
 #include "../libs/notificationmessagev3_p.h"
+#include "../libs/notificationmessagev2_p_p.h"
 #include "storage/entity.h"
 
 #include <QtCore/QHash>
 #include <QtCore/QObject>
+#include <QtCore/QSet>
+#include <QtCore/QTime>
 #include <QtCore/QTimer>
+#include <QtCore/QVariant>
+#include <QtCore/QVector>
 #include <QtDBus/qdbuscontext.h>
 
 class NotificationManagerTest;
@@ -97,6 +102,12 @@ class NotificationManager : public QObject, protected QDBusContext
      */
     Q_SCRIPTABLE QStringList subscribers() const;
 
+    /**
+     * Returns the queue depth, the current flush interval, flush latency
+     * statistics and the delivery statistics of each subscriber.
+     */
+    Q_SCRIPTABLE QVariantMap statistics() const;
+
   Q_SIGNALS:
     Q_SCRIPTABLE void notify( const Akonadi::NotificationMessage::List &msgs );
 
@@ -105,20 +116,84 @@ class NotificationManager : public QObject, protected QDBusContext
 
   private Q_SLOTS:
     void slotNotify( const Akonadi::NotificationMessageV3::List &msgs );
+    void invalidateSubscriptionIndex();
 
   private:
     NotificationManager();
 
   private:
+    typedef QVector<NotificationSource *> SourceList;
+
+    /**
+     * Inverted index of the subscriptions of all sources, used to find the
+     * sources that can possibly accept a notification without asking each of them.
+     */
+    struct SubscriptionIndex
+    {
+      QHash<Entity::Id, SourceList> collections;
+      QHash<Entity::Id, SourceList> items;
+      QHash<Entity::Id, SourceList> tags;
+      QHash<QByteArray, SourceList> resources;
+      QHash<QString, SourceList> mimeTypes;
+      //! Sources monitoring collection 0, i.e. all collections
+      SourceList allCollections;
+      //! Sources without a tag filter
+      SourceList allTags;
+    };
+
     void registerSource( NotificationSource *source );
     void unregisterSource( NotificationSource *source );
 
+    void updateSubscriptionIndex();
+
+    /**
+     * Adds the sources which might accept @p notification to @p candidates.
+     * Returns @c false if all sources have to be asked.
+     */
+    bool collectCandidates( const NotificationMessageV3 &notification, QSet<NotificationSource *> &candidates ) const;
+
+    /**
+     * Returns the indexes of the pending notifications accepted by each source
+     * with server-side monitoring enabled.
+     */
+    QHash<NotificationSource *, QVector<int> > routeNotifications();
+
+    /**
+     * Updates the statistics after a flush and adapts the flush interval to
+     * the size of the batch.
+     */
+    void updateFlushStatistics( int batchSize, int queueLatency );
+
     static NotificationManager *mSelf;
+    //! Notifications collected until the next emitPendingNotifications()
+    NotificationMessageCompressor<NotificationMessageV3> mPendingNotifications;
+    //! Notifications being emitted
     NotificationMessageV3::List mNotifications;
     QTimer mTimer;
+    //! Configured flush interval, used while the server is not busy
+    int mBaseInterval;
+    int mMaxInterval;
+    //! Current flush interval
+    int mInterval;
+    //! Number of pending notifications causing an immediate flush
+    int mMaxQueueSize;
+    //! Maximum number of notifications in a single signal
+    int mMaxBatchSize;
+    //! Time since the oldest pending notification has been queued
+    QTime mQueueTime;
+    QTime mLastFlush;
+
+    qint64 mFlushCount;
+    qint64 mEmittedCount;
+    int mLastBatchSize;
+    int mLastFlushLatency;
+    int mMaxFlushLatency;
+    qint64 mTotalFlushLatency;
 
     //! One message source for each subscribed process
     QHash<QString, NotificationSource *> mNotificationSources;
+    SubscriptionIndex mSubscriptionIndex;
+    bool mSubscriptionIndexDirty;
 
     friend class NotificationSource;
     friend class ::NotificationManagerTest;
@@ -45,6 +45,8 @@ NotificationSource::NotificationSource( const QString &identifier, const QString
   , mServerSideMonitorEnabled( false )
   , mAllMonitored( false )
   , mExclusive( false )
+  , mDeliveredNotifications( 0 )
+  , mDeliveredBatches( 0 )
 {
   new NotificationSourceAdaptor( this );
 
@@ -77,16 +79,41 @@ QDBusObjectPath NotificationSource::dbusPath() const
 void NotificationSource::emitNotification( const NotificationMessage::List &notifications )
 {
   Q_EMIT notify( notifications );
+  delivered( notifications.count() );
 }
 
 void NotificationSource::emitNotification( const NotificationMessageV2::List &notifications )
 {
   Q_EMIT notifyV2( notifications );
+  delivered( notifications.count() );
 }
 
 void NotificationSource::emitNotification( const NotificationMessageV3::List &notifications )
 {
   Q_EMIT notifyV3( notifications );
+  delivered( notifications.count() );
+}
+
+void NotificationSource::delivered( int count )
+{
+  mDeliveredNotifications += count;
+  ++mDeliveredBatches;
+  mLastDelivery.start();
+}
+
+qint64 NotificationSource::deliveredNotificationsCount() const
+{
+  return mDeliveredNotifications;
+}
+
+qint64 NotificationSource::deliveredBatchesCount() const
+{
+  return mDeliveredBatches;
+}
+
+int NotificationSource::lastDeliveryAge() const
+{
+  return mLastDelivery.isValid() ? mLastDelivery.elapsed() : -1;
 }
 
 QString NotificationSource::identifier() const
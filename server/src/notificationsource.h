@@ -24,6 +24,7 @@
 #include "../libs/notificationmessagev3_p.h"
 
 #include <QtCore/QObject>
+#include <QtCore/QTime>
 #include <QtCore/QVector>
 #include <QtDBus/QtDBus>
 
@@ -97,6 +98,22 @@ class NotificationSource : public QObject
 
     bool acceptsNotification( const NotificationMessageV3 &notification );
 
+    /**
+     * Returns the number of notifications emitted to this source so far.
+     */
+    qint64 deliveredNotificationsCount() const;
+
+    /**
+     * Returns the number of signals emitted to this source so far.
+     */
+    qint64 deliveredBatchesCount() const;
+
+    /**
+     * Returns the number of milliseconds since the last notifications were
+     * emitted to this source, or -1 if there were none yet.
+     */
+    int lastDeliveryAge() const;
+
   public Q_SLOTS:
     /**
       * Unsubscribe from the message source.
@@ -147,6 +164,7 @@ class NotificationSource : public QObject
     bool isCollectionMonitored( Entity::Id id ) const;
     bool isMimeTypeMonitored( const QString &mimeType ) const;
     bool isMoveDestinationResourceMonitored( const NotificationMessageV3 &msg ) const;
+    void delivered( int count );
 
   private:
     NotificationManager *mManager;
@@ -167,6 +185,10 @@ class NotificationSource : public QObject
     QSet<QByteArray> mIgnoredSessions;
     QByteArray mSession;
 
+    qint64 mDeliveredNotifications;
+    qint64 mDeliveredBatches;
+    QTime mLastDelivery;
+
 }; // class NotificationSource
 
 } // namespace Server
@@ -33,6 +33,9 @@ class NullTracer : public TracerInterface
   public:
     virtual ~NullTracer() {}
 
+    virtual bool isEnabled() const
+    { return false; }
+
     virtual void beginConnection( const QString &identifier, const QString &msg )
     { Q_UNUSED( identifier ); Q_UNUSED( msg ); }
 
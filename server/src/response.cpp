@@ -38,7 +38,9 @@ Response::~Response()
 
 QByteArray Response::asString() const
 {
-    QByteArray b = m_tag;
+    QByteArray b;
+    b.reserve( m_tag.size() + 5 + m_responseString.size() );
+    b += m_tag;
     if ( m_tag != "*" && m_tag != "+" && m_resultCode != USER ) {
         b += ' ';
         b += s_resultCodeStrings[m_resultCode];
@@ -48,6 +50,38 @@ QByteArray Response::asString() const
     return b;
 }
 
+int Response::prefixLength() const
+{
+    int length = m_tag.size() + 1;
+    if ( m_tag != "*" && m_tag != "+" && m_resultCode != USER ) {
+        length += qstrlen( s_resultCodeStrings[m_resultCode] ) + 1;
+    }
+    return length;
+}
+
+void Response::addFileLiteral( int position, const QString &fileName, qint64 size )
+{
+    FileLiteral literal;
+    literal.position = position;
+    literal.fileName = fileName;
+    literal.size = size;
+    m_fileLiterals.append( literal );
+}
+
+QVector<Response::FileLiteral> Response::fileLiterals() const
+{
+    if ( m_fileLiterals.isEmpty() ) {
+        return m_fileLiterals;
+    }
+
+    QVector<FileLiteral> literals = m_fileLiterals;
+    const int offset = prefixLength();
+    for ( int i = 0; i < literals.size(); ++i ) {
+        literals[i].position += offset;
+    }
+    return literals;
+}
+
 Response::ResultCode Response::resultCode() const
 {
   return m_resultCode;
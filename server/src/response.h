@@ -21,6 +21,8 @@
 
 #include <QByteArray>
 #include <QMetaType>
+#include <QString>
+#include <QVector>
 
 namespace Akonadi {
 namespace Server {
@@ -44,6 +46,17 @@ public:
 
     ~Response();
 
+    /**
+      A file whose content is spliced into the response when it is written
+      to the client, without loading it into memory.
+     */
+    struct FileLiteral {
+        /** Offset into asString() at which the file content is inserted. */
+        int position;
+        QString fileName;
+        qint64 size;
+    };
+
     ResultCode resultCode() const;
 
     /** The response string to be sent to the client. */
@@ -56,15 +69,28 @@ public:
     void setString( const char *string );
     void setString( const QByteArray &string );
 
+    /**
+      Inserts the first @p size bytes of the file @p fileName at @p position
+      of the response string. The literal header has to be part of the
+      response string already, literals have to be added in ascending order
+      of their position.
+     */
+    void addFileLiteral( int position, const QString &fileName, qint64 size );
+    /** The file literals to insert into asString(). */
+    QVector<FileLiteral> fileLiterals() const;
+
     void setSuccess();
     void setFailure();
     void setError();
     void setBye();
     void setUserDefined();
 private:
+    int prefixLength() const;
+
     QByteArray m_responseString;
     ResultCode m_resultCode;
     QByteArray m_tag;
+    QVector<FileLiteral> m_fileLiterals;
 };
 
 } // namespace Server
@@ -0,0 +1,151 @@
+/*
+    Copyright (c) 2014 Akonadi developers
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+#include "ringbuffertracer.h"
+
+#include <QtCore/QDateTime>
+#include <QtCore/QFile>
+#include <QtCore/QtEndian>
+
+#include <string.h>
+
+using namespace Akonadi::Server;
+
+// record size, timestamp, type, identifier size
+static const int s_headerSize = 4 + 8 + 1 + 2;
+static const int s_maxIdentifierSize = 255;
+static const int s_minBufferSize = 4096;
+
+RingBufferTracer::RingBufferTracer( const QString &fileName, int bufferSize )
+  : mFileName( fileName )
+  , mTail( 0 )
+  , mHead( 0 )
+  , mUsed( 0 )
+{
+  mBuffer.resize( qMax( bufferSize, s_minBufferSize ) );
+}
+
+RingBufferTracer::~RingBufferTracer()
+{
+  dump();
+}
+
+void RingBufferTracer::dump()
+{
+  if ( mFileName.isEmpty() ) {
+    return;
+  }
+
+  QFile file( mFileName );
+  if ( file.open( QIODevice::WriteOnly | QIODevice::Truncate ) ) {
+    file.write( "AKTRACE1", 8 );
+    file.write( records() );
+  }
+}
+
+void RingBufferTracer::beginConnection( const QString &identifier, const QString &msg )
+{
+  append( BeginConnection, identifier, msg.toUtf8() );
+}
+
+void RingBufferTracer::endConnection( const QString &identifier, const QString &msg )
+{
+  append( EndConnection, identifier, msg.toUtf8() );
+}
+
+void RingBufferTracer::connectionInput( const QString &identifier, const QByteArray &msg )
+{
+  append( ConnectionInput, identifier, msg );
+}
+
+void RingBufferTracer::connectionOutput( const QString &identifier, const QByteArray &msg )
+{
+  append( ConnectionOutput, identifier, msg );
+}
+
+void RingBufferTracer::signal( const QString &signalName, const QString &msg )
+{
+  append( Signal, signalName, msg.toUtf8() );
+}
+
+void RingBufferTracer::warning( const QString &componentName, const QString &msg )
+{
+  append( Warning, componentName, msg.toUtf8() );
+}
+
+void RingBufferTracer::error( const QString &componentName, const QString &msg )
+{
+  append( Error, componentName, msg.toUtf8() );
+}
+
+QByteArray RingBufferTracer::records() const
+{
+  QByteArray result;
+  result.resize( mUsed );
+  read( mTail, result.data(), mUsed );
+  return result;
+}
+
+void RingBufferTracer::append( RecordType type, const QString &identifier, const QByteArray &msg )
+{
+  const QByteArray id = identifier.toUtf8().left( s_maxIdentifierSize );
+  const int capacity = mBuffer.size();
+  // messages which don't fit into the buffer at all are truncated
+  const int msgSize = qMin( msg.size(), capacity - s_headerSize - id.size() );
+  const int recordSize = s_headerSize + id.size() + msgSize;
+
+  // drop the oldest records until there is enough space
+  while ( capacity - mUsed < recordSize ) {
+    uchar sizeData[4];
+    read( mTail, reinterpret_cast<char *>( sizeData ), 4 );
+    const int size = qFromLittleEndian<quint32>( sizeData );
+    mTail = ( mTail + size ) % capacity;
+    mUsed -= size;
+  }
+
+  uchar header[s_headerSize];
+  qToLittleEndian<quint32>( recordSize, header );
+  qToLittleEndian<qint64>( QDateTime::currentMSecsSinceEpoch(), header + 4 );
+  header[12] = static_cast<uchar>( type );
+  qToLittleEndian<quint16>( id.size(), header + 13 );
+
+  write( reinterpret_cast<const char *>( header ), s_headerSize );
+  write( id.constData(), id.size() );
+  write( msg.constData(), msgSize );
+  mUsed += recordSize;
+}
+
+void RingBufferTracer::write( const char *data, int size )
+{
+  const int capacity = mBuffer.size();
+  const int first = qMin( size, capacity - mHead );
+  char *buffer = mBuffer.data();
+  memcpy( buffer + mHead, data, first );
+  memcpy( buffer, data + first, size - first );
+  mHead = ( mHead + size ) % capacity;
+}
+
+void RingBufferTracer::read( int position, char *data, int size ) const
+{
+  const int capacity = mBuffer.size();
+  const int first = qMin( size, capacity - position );
+  const char *buffer = mBuffer.constData();
+  memcpy( data, buffer + position, first );
+  memcpy( data + first, buffer, size - first );
+}
@@ -0,0 +1,107 @@
+/*
+    Copyright (c) 2014 Akonadi developers
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+#ifndef AKONADI_RINGBUFFERTRACER_H
+#define AKONADI_RINGBUFFERTRACER_H
+
+#include "tracerinterface.h"
+
+#include <QtCore/QByteArray>
+#include <QtCore/QString>
+
+namespace Akonadi {
+namespace Server {
+
+/**
+ * A tracer which keeps the most recent tracing information in a fixed-size
+ * in-memory ring buffer and writes it to a file when it is dumped or
+ * deactivated.
+ *
+ * Unlike the FileTracer, tracing does not format any strings and does not
+ * touch the disk, so it can stay enabled on a busy server. When the buffer is
+ * full, the oldest records are dropped.
+ *
+ * The file starts with the 8 byte magic "AKTRACE1", followed by the records,
+ * oldest first. All integers are little endian. A record consists of:
+ *   - quint32 size of the whole record, including this field
+ *   - qint64 milliseconds since the epoch
+ *   - quint8 record type (see RecordType)
+ *   - quint16 size of the identifier, followed by the UTF-8 encoded identifier
+ *   - the message, raw for connection input and output, UTF-8 encoded otherwise
+ */
+class RingBufferTracer : public TracerInterface
+{
+  public:
+    enum RecordType {
+      BeginConnection = 0,
+      EndConnection,
+      ConnectionInput,
+      ConnectionOutput,
+      Signal,
+      Warning,
+      Error
+    };
+
+    /**
+     * Creates a new ring buffer tracer keeping up to @p bufferSize bytes,
+     * which are written to @p fileName by dump() and on destruction. An empty @p fileName
+     * keeps the records in memory only.
+     */
+    RingBufferTracer( const QString &fileName, int bufferSize );
+    virtual ~RingBufferTracer();
+
+    virtual void beginConnection( const QString &identifier, const QString &msg );
+    virtual void endConnection( const QString &identifier, const QString &msg );
+    virtual void connectionInput( const QString &identifier, const QByteArray &msg );
+    virtual void connectionOutput( const QString &identifier, const QByteArray &msg );
+    virtual void signal( const QString &signalName, const QString &msg );
+    virtual void warning( const QString &componentName, const QString &msg );
+    virtual void error( const QString &componentName, const QString &msg );
+
+    /**
+     * Writes the magic and the buffered records to the file, replacing its
+     * previous content. The records stay in the buffer.
+     */
+    virtual void dump();
+
+    /**
+     * Returns the buffered records, oldest first, in the file format
+     * described above, without the magic.
+     */
+    QByteArray records() const;
+
+  private:
+    void append( RecordType type, const QString &identifier, const QByteArray &msg );
+    void write( const char *data, int size );
+    void read( int position, char *data, int size ) const;
+
+    QString mFileName;
+    QByteArray mBuffer;
+    /// position of the oldest record
+    int mTail;
+    /// position where the next record is written
+    int mHead;
+    /// number of bytes used by records
+    int mUsed;
+};
+
+} // namespace Server
+} // namespace Akonadi
+
+#endif
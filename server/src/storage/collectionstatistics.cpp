@@ -0,0 +1,199 @@
+/*
+    Copyright (c) 2014 Akonadi developers
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+#include "collectionstatistics.h"
+#include "akdebug.h"
+#include "handlerhelper.h"
+#include "storage/querybuilder.h"
+
+#include <libs/protocol_p.h>
+
+using namespace Akonadi::Server;
+
+CollectionStatistics *CollectionStatistics::sInstance = 0;
+static QMutex s_instanceLock;
+
+CollectionStatistics *CollectionStatistics::self()
+{
+  QMutexLocker locker( &s_instanceLock );
+  if ( !sInstance ) {
+    sInstance = new CollectionStatistics();
+  }
+  return sInstance;
+}
+
+CollectionStatistics::CollectionStatistics()
+  : mGeneration( 0 )
+{
+}
+
+static QVariantList readFlagIds()
+{
+  QVariantList ids;
+  ids << Flag::retrieveByName( QLatin1String( AKONADI_FLAG_SEEN ) ).id()
+      << Flag::retrieveByName( QLatin1String( AKONADI_FLAG_IGNORED ) ).id();
+  return ids;
+}
+
+bool CollectionStatistics::statistics( const Collection &collection, Statistics &statistics )
+{
+  if ( collection.isVirtual() ) {
+    return calculateStatistics( collection, statistics );
+  }
+
+  quint64 generation;
+  {
+    QMutexLocker locker( &mLock );
+    QHash<Collection::Id, Statistics>::const_iterator it = mCache.constFind( collection.id() );
+    if ( it != mCache.constEnd() ) {
+      statistics = it.value();
+      return true;
+    }
+    generation = mGeneration;
+  }
+
+  if ( !calculateStatistics( collection, statistics ) ) {
+    return false;
+  }
+
+  // only cache the result if nobody changed the collection in the meantime
+  QMutexLocker locker( &mLock );
+  if ( generation == mGeneration && !mPendingChanges.contains( collection.id() ) ) {
+    mCache.insert( collection.id(), statistics );
+  }
+  return true;
+}
+
+void CollectionStatistics::beginChange( Collection::Id collectionId )
+{
+  QMutexLocker locker( &mLock );
+  ++mPendingChanges[collectionId];
+  ++mGeneration;
+}
+
+void CollectionStatistics::commitChange( Collection::Id collectionId, const Statistics &delta )
+{
+  QMutexLocker locker( &mLock );
+  if ( --mPendingChanges[collectionId] <= 0 ) {
+    mPendingChanges.remove( collectionId );
+  }
+  ++mGeneration;
+
+  QHash<Collection::Id, Statistics>::iterator it = mCache.find( collectionId );
+  if ( it != mCache.end() ) {
+    it->count += delta.count;
+    it->size += delta.size;
+    it->read += delta.read;
+  }
+}
+
+void CollectionStatistics::abortChange( Collection::Id collectionId )
+{
+  QMutexLocker locker( &mLock );
+  if ( --mPendingChanges[collectionId] <= 0 ) {
+    mPendingChanges.remove( collectionId );
+  }
+  ++mGeneration;
+  mCache.remove( collectionId );
+}
+
+void CollectionStatistics::invalidateCollection( Collection::Id collectionId )
+{
+  QMutexLocker locker( &mLock );
+  ++mGeneration;
+  mCache.remove( collectionId );
+}
+
+int CollectionStatistics::recalculateAll()
+{
+  quint64 generation;
+  {
+    QMutexLocker locker( &mLock );
+    generation = mGeneration;
+  }
+
+  QHash<Collection::Id, Statistics> all;
+
+  QueryBuilder countQb( PimItem::tableName() );
+  countQb.addColumn( PimItem::collectionIdColumn() );
+  countQb.addAggregation( PimItem::idColumn(), QLatin1String( "count" ) );
+  countQb.addAggregation( PimItem::sizeColumn(), QLatin1String( "sum" ) );
+  countQb.addGroupColumn( PimItem::collectionIdColumn() );
+  if ( !countQb.exec() ) {
+    return -1;
+  }
+  while ( countQb.query().next() ) {
+    Statistics &statistics = all[countQb.query().value( 0 ).toLongLong()];
+    statistics.count = countQb.query().value( 1 ).toLongLong();
+    statistics.size = countQb.query().value( 2 ).toLongLong();
+  }
+  countQb.query().finish();
+
+  QueryBuilder readQb( PimItem::tableName() );
+  readQb.addColumn( PimItem::collectionIdFullColumnName() );
+  readQb.addAggregation( QLatin1String( "DISTINCT " ) + PimItem::idFullColumnName(), QLatin1String( "count" ) );
+  readQb.addJoin( QueryBuilder::InnerJoin, PimItemFlagRelation::tableName(),
+                  PimItem::idFullColumnName(), PimItemFlagRelation::leftFullColumnName() );
+  readQb.addValueCondition( PimItemFlagRelation::rightFullColumnName(), Query::In, readFlagIds() );
+  readQb.addGroupColumn( PimItem::collectionIdFullColumnName() );
+  if ( !readQb.exec() ) {
+    return -1;
+  }
+  while ( readQb.query().next() ) {
+    all[readQb.query().value( 0 ).toLongLong()].read = readQb.query().value( 1 ).toLongLong();
+  }
+  readQb.query().finish();
+
+  QMutexLocker locker( &mLock );
+  int wrong = 0;
+  for ( QHash<Collection::Id, Statistics>::const_iterator it = mCache.constBegin(); it != mCache.constEnd(); ++it ) {
+    const Statistics actual = all.value( it.key() );
+    if ( actual.count != it->count || actual.size != it->size || actual.read != it->read ) {
+      akDebug() << "Statistics of collection" << it.key() << "were out of date";
+      ++wrong;
+    }
+  }
+
+  if ( generation == mGeneration ) {
+    for ( QHash<Collection::Id, int>::const_iterator it = mPendingChanges.constBegin(); it != mPendingChanges.constEnd(); ++it ) {
+      all.remove( it.key() );
+    }
+    mCache = all;
+  } else {
+    // something changed while we were calculating, recalculate on demand
+    mCache.clear();
+  }
+
+  return wrong;
+}
+
+bool CollectionStatistics::calculateStatistics( const Collection &collection, Statistics &statistics )
+{
+  if ( !HandlerHelper::itemStatistics( collection, statistics.count, statistics.size ) ) {
+    return false;
+  }
+  // itemWithFlagsCount is twice as fast as itemWithoutFlagsCount
+  const int read = HandlerHelper::itemWithFlagsCount( collection, QStringList() << QLatin1String( AKONADI_FLAG_SEEN )
+                                                                                << QLatin1String( AKONADI_FLAG_IGNORED ) );
+  if ( read < 0 ) {
+    return false;
+  }
+  statistics.read = read;
+  return true;
+}
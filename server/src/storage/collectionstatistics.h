@@ -0,0 +1,114 @@
+/*
+    Copyright (c) 2014 Akonadi developers
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+#ifndef AKONADI_COLLECTIONSTATISTICS_H
+#define AKONADI_COLLECTIONSTATISTICS_H
+
+#include "entities.h"
+
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
+
+namespace Akonadi {
+namespace Server {
+
+/**
+ * Process-wide cache of the item count, total size and read item count of
+ * collections, shared by all connections.
+ *
+ * Statistics of a collection are calculated on first use and are then kept up
+ * to date incrementally by the NotificationCollector. Changes made inside a
+ * transaction are announced with beginChange() and only applied on commit;
+ * until then, no statistics of that collection are cached, since the database
+ * content visible to other connections might or might not include them.
+ * Statistics of virtual collections are never cached.
+ */
+class CollectionStatistics
+{
+  public:
+    struct Statistics
+    {
+      Statistics()
+        : count( 0 )
+        , size( 0 )
+        , read( 0 )
+      {
+      }
+
+      qint64 count;
+      qint64 size;
+      /// number of items flagged as \SEEN or $IGNORED
+      qint64 read;
+    };
+
+    static CollectionStatistics *self();
+
+    /**
+     * Returns the statistics of @p collection. Returns @c false if they could
+     * not be calculated.
+     */
+    bool statistics( const Collection &collection, Statistics &statistics );
+
+    /**
+     * Marks the statistics of @p collectionId as being changed by a transaction
+     * that has not been committed yet.
+     */
+    void beginChange( Collection::Id collectionId );
+
+    /**
+     * Applies the change started with beginChange(). @p delta is added to the
+     * cached statistics, if any.
+     */
+    void commitChange( Collection::Id collectionId, const Statistics &delta );
+
+    /**
+     * Ends the change started with beginChange() without applying it and drops
+     * the cached statistics of @p collectionId.
+     */
+    void abortChange( Collection::Id collectionId );
+
+    /** Drops the cached statistics of @p collectionId, they are recalculated when needed. */
+    void invalidateCollection( Collection::Id collectionId );
+
+    /**
+     * Recalculates the statistics of all collections at once.
+     * Returns the number of collections whose cached statistics were wrong,
+     * or -1 if the statistics could not be calculated.
+     */
+    int recalculateAll();
+
+  private:
+    CollectionStatistics();
+
+    static bool calculateStatistics( const Collection &collection, Statistics &statistics );
+
+    static CollectionStatistics *sInstance;
+
+    QMutex mLock;
+    QHash<Collection::Id, Statistics> mCache;
+    /// number of uncommitted transactions changing a collection
+    QHash<Collection::Id, int> mPendingChanges;
+    /// incremented on every change, to detect changes while calculating statistics
+    quint64 mGeneration;
+};
+
+} // namespace Server
+} // namespace Akonadi
+
+#endif
@@ -74,12 +74,30 @@ QThreadStorage<DataStore*> DataStore::sInstances;
   } \
 }
 
+/// Returns whether @p flag marks an item as read for the collection statistics
+static bool isReadFlag( const Flag &flag )
+{
+  return flag.name() == QLatin1String( AKONADI_FLAG_SEEN )
+      || flag.name() == QLatin1String( AKONADI_FLAG_IGNORED );
+}
+
+static bool containsReadFlag( const QVector<Flag> &flags )
+{
+  Q_FOREACH ( const Flag &flag, flags ) {
+    if ( isReadFlag( flag ) ) {
+      return true;
+    }
+  }
+  return false;
+}
+
 /***************************************************************************
  *   DataStore                                                           *
  ***************************************************************************/
 DataStore::DataStore()
   : QObject()
   , m_dbOpened( false )
+  , m_connectionReleased( false )
   , m_transactionLevel( 0 )
   , mNotificationCollector( 0 )
   , m_keepAliveTimer( 0 )
@@ -125,6 +143,10 @@ void DataStore::open()
   }
 
   DbConfig::configuredDatabase()->initSession( m_database );
+
+  if ( m_keepAliveTimer ) {
+    m_keepAliveTimer->start();
+  }
 }
 
 void DataStore::close()
@@ -153,6 +175,31 @@ void DataStore::close()
   m_dbOpened = false;
 }
 
+void DataStore::releaseConnection()
+{
+  if ( !m_dbOpened || inTransaction() ) {
+    return;
+  }
+
+  close();
+  m_connectionReleased = true;
+}
+
+bool DataStore::ensureOpened()
+{
+  if ( !m_dbOpened && m_connectionReleased ) {
+    m_connectionReleased = false;
+    open();
+  }
+  return m_dbOpened;
+}
+
+QSqlDatabase DataStore::database()
+{
+  ensureOpened();
+  return m_database;
+}
+
 bool DataStore::init()
 {
   Q_ASSERT( QThread::currentThread() == QCoreApplication::instance()->thread() );
@@ -215,23 +262,74 @@ bool DataStore::setItemsFlags( const PimItem::List &items, const QVector<Flag> &
   QSet<QByteArray> addedFlags;
   QVariantList insIds;
   QVariantList insFlags;
-  Query::Condition delConds( Query::Or );
+  QHash<Flag::Id, QVariantList> delIds;
+
+  QHash<Collection::Id, qint64> readDelta;
+  const bool read = containsReadFlag( flags );
+
+  QSet<Flag::Id> flagIds;
+  Q_FOREACH ( const Flag &flag, flags ) {
+    flagIds.insert( flag.id() );
+  }
 
   setBoolPtr( flagsChanged, false );
 
+  // Query in batches, because something can't handle queries with more than 999 bound values,
+  // leave some room for the values bound besides the WHERE IN set
+  const int chunkSize = 990;
+
+  // Load the current flags of all items at once instead of asking every item for them
+  QHash<PimItem::Id, QVector<Flag::Id> > itemFlags;
+  for ( int start = 0; start < items.size(); start += chunkSize ) {
+    QVariantList ids;
+    const int end = qMin( start + chunkSize, items.size() );
+    for ( int i = start; i < end; ++i ) {
+      ids << items.at( i ).id();
+    }
+
+    QueryBuilder qb( PimItemFlagRelation::tableName(), QueryBuilder::Select );
+    qb.addColumn( PimItemFlagRelation::leftColumn() );
+    qb.addColumn( PimItemFlagRelation::rightColumn() );
+    qb.addValueCondition( PimItemFlagRelation::leftColumn(), Query::In, ids );
+    if ( !qb.exec() ) {
+      return false;
+    }
+    QSqlQuery query = qb.query();
+    while ( query.next() ) {
+      itemFlags[query.value( 0 ).toLongLong()] << query.value( 1 ).toLongLong();
+    }
+    query.finish();
+  }
+
+  QHash<Flag::Id, Flag> knownFlags;
+  Q_FOREACH ( const Flag &flag, flags ) {
+    knownFlags.insert( flag.id(), flag );
+  }
+
   Q_FOREACH ( const PimItem &item, items ) {
-    Q_FOREACH ( const Flag &flag, item.flags() ) {
-      if ( !flags.contains( flag ) ) {
-        removedFlags << flag.name().toLatin1();
-        Query::Condition cond;
-        cond.addValueCondition( PimItemFlagRelation::leftFullColumnName(), Query::Equals, item.id() );
-        cond.addValueCondition( PimItemFlagRelation::rightFullColumnName(), Query::Equals, flag.id() );
-        delConds.addCondition(cond);
+    const QVector<Flag::Id> currentFlags = itemFlags.value( item.id() );
+    bool wasRead = false;
+
+    Q_FOREACH ( Flag::Id flagId, currentFlags ) {
+      QHash<Flag::Id, Flag>::Iterator it = knownFlags.find( flagId );
+      if ( it == knownFlags.end() ) {
+        it = knownFlags.insert( flagId, Flag::retrieveById( flagId ) );
+      }
+      if ( isReadFlag( it.value() ) ) {
+        wasRead = true;
+      }
+      if ( !flagIds.contains( flagId ) ) {
+        removedFlags << it.value().name().toLatin1();
+        delIds[flagId] << item.id();
       }
     }
 
+    if ( wasRead != read ) {
+      readDelta[item.collectionId()] += read ? 1 : -1;
+    }
+
     Q_FOREACH ( const Flag &flag, flags ) {
-      if ( !item.flags().contains( flag ) ) {
+      if ( !currentFlags.contains( flag.id() ) ) {
         addedFlags << flag.name().toLatin1();
         insIds << item.id();
         insFlags << flag.id();
@@ -239,11 +337,15 @@ bool DataStore::setItemsFlags( const PimItem::List &items, const QVector<Flag> &
     }
   }
 
-  if ( !removedFlags.empty() ) {
-    QueryBuilder qb( PimItemFlagRelation::tableName(), QueryBuilder::Delete );
-    qb.addCondition( delConds );
-    if ( !qb.exec() ) {
-      return false;
+  // Remove each flag from all its items with chunked set-based deletes
+  for ( QHash<Flag::Id, QVariantList>::ConstIterator it = delIds.constBegin(); it != delIds.constEnd(); ++it ) {
+    for ( int start = 0; start < it.value().size(); start += chunkSize ) {
+      QueryBuilder qb( PimItemFlagRelation::tableName(), QueryBuilder::Delete );
+      qb.addValueCondition( PimItemFlagRelation::rightFullColumnName(), Query::Equals, it.key() );
+      qb.addValueCondition( PimItemFlagRelation::leftFullColumnName(), Query::In, it.value().mid( start, chunkSize ) );
+      if ( !qb.exec() ) {
+        return false;
+      }
     }
   }
 
@@ -257,6 +359,10 @@ bool DataStore::setItemsFlags( const PimItem::List &items, const QVector<Flag> &
     }
   }
 
+  for ( QHash<Collection::Id, qint64>::const_iterator it = readDelta.constBegin(); it != readDelta.constEnd(); ++it ) {
+    mNotificationCollector->collectionStatisticsChanged( it.key(), 0, 0, it.value() );
+  }
+
   if ( !silent && ( !addedFlags.isEmpty() || !removedFlags.isEmpty() ) ) {
     mNotificationCollector->itemsFlagsChanged( items, addedFlags, removedFlags );
   }
@@ -296,6 +402,11 @@ bool DataStore::doAppendItemsFlag( const PimItem::List &items, const Flag &flag,
     return false;
   }
 
+  // the item might have been read already through the other read flag
+  if ( isReadFlag( flag ) ) {
+    invalidateCollectionStatistics( appendItems );
+  }
+
   if ( !silent ) {
     mNotificationCollector->itemsFlagsChanged( appendItems, QSet<QByteArray>() << flag.name().toLatin1(),
                                                QSet<QByteArray>(), col );
@@ -392,6 +503,9 @@ bool DataStore::removeItemsFlags( const PimItem::List &items, const QVector<Flag
 
   if ( qb.query().numRowsAffected() != 0 ) {
     setBoolPtr( flagsChanged, true );
+    if ( containsReadFlag( flags ) ) {
+      invalidateCollectionStatistics( items );
+    }
     if ( !silent ) {
       mNotificationCollector->itemsFlagsChanged( items, QSet<QByteArray>(), removedFlags );
     }
@@ -400,6 +514,17 @@ bool DataStore::removeItemsFlags( const PimItem::List &items, const QVector<Flag
   return true;
 }
 
+void DataStore::invalidateCollectionStatistics( const PimItem::List &items )
+{
+  QSet<Collection::Id> collections;
+  Q_FOREACH ( const PimItem &item, items ) {
+    collections.insert( item.collectionId() );
+  }
+  Q_FOREACH ( Collection::Id collectionId, collections ) {
+    mNotificationCollector->invalidateCollectionStatistics( collectionId );
+  }
+}
+
 /* --- ItemTags ----------------------------------------------------- */
 
 bool DataStore::setItemsTags( const PimItem::List &items, const Tag::List &tags,
@@ -837,7 +962,7 @@ bool DataStore::moveCollection( Collection &collection, const Collection &newPar
     return true;
   }
 
-  if ( !m_dbOpened || !newParent.isValid() ) {
+  if ( !ensureOpened() || !newParent.isValid() ) {
     return false;
   }
 
@@ -906,6 +1031,11 @@ bool DataStore::appendMimeTypeForCollection( qint64 collectionId, const QStringL
 }
 
 void DataStore::activeCachePolicy( Collection &col )
+{
+  activeCachePolicy( col, QHash<Collection::Id, Collection>() );
+}
+
+void DataStore::activeCachePolicy( Collection &col, const QHash<Collection::Id, Collection> &collections )
 {
   if ( !col.cachePolicyInherit() ) {
     return;
@@ -913,7 +1043,8 @@ void DataStore::activeCachePolicy( Collection &col )
 
   Collection parent = col;
   while ( parent.parentId() != 0 ) {
-    parent = parent.parent();
+    const QHash<Collection::Id, Collection>::const_iterator it = collections.constFind( parent.parentId() );
+    parent = ( it != collections.constEnd() ) ? it.value() : parent.parent();
     if ( !parent.cachePolicyInherit() ) {
       col.setCachePolicyCheckInterval( parent.cachePolicyCheckInterval() );
       col.setCachePolicyCacheTimeout( parent.cachePolicyCacheTimeout() );
@@ -1066,7 +1197,7 @@ bool DataStore::appendPimItem( QVector<Part> &parts,
 
 bool DataStore::unhidePimItem( PimItem &pimItem )
 {
-  if ( !m_dbOpened ) {
+  if ( !ensureOpened() ) {
     return false;
   }
 
@@ -1081,7 +1212,7 @@ bool DataStore::unhidePimItem( PimItem &pimItem )
 
 bool DataStore::unhideAllPimItems()
 {
-  if ( !m_dbOpened ) {
+  if ( !ensureOpened() ) {
     return false;
   }
 
@@ -1314,7 +1445,7 @@ QSqlQuery DataStore::retryLastTransaction( bool rollbackFirst )
 
 bool DataStore::beginTransaction()
 {
-  if ( !m_dbOpened ) {
+  if ( !ensureOpened() ) {
     return false;
   }
 
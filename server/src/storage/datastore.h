@@ -21,6 +21,7 @@
 #define DATASTORE_H
 
 #include <QtCore/QObject>
+#include <QtCore/QHash>
 #include <QtCore/QList>
 #include <QtCore/QMutex>
 #include <QtCore/QVector>
@@ -108,6 +109,14 @@ class DataStore : public QObject
     */
     virtual void close();
 
+    /**
+      Closes the database connection of an idle client connection, to keep the
+      number of open database connections down. The database connection is
+      opened again transparently when it is used next time.
+      Does nothing while a transaction is in progress.
+    */
+    void releaseConnection();
+
     /**
       Initializes the database. Should be called during startup by the main thread.
     */
@@ -159,6 +168,12 @@ class DataStore : public QObject
     */
     virtual void activeCachePolicy( Collection &col );
 
+    /**
+      Same as above, but looks the parents up in @p collections first and
+      only retrieves those which are not contained.
+    */
+    void activeCachePolicy( Collection &col, const QHash<Collection::Id, Collection> &collections );
+
     /// Returns all virtual collections the @p item is linked to
     QVector<Collection> virtualCollections( const PimItem &item );
 
@@ -247,7 +262,7 @@ class DataStore : public QObject
     /**
       Returns the QSqlDatabase object. Use this for generating queries yourself.
     */
-    QSqlDatabase database() const { return m_database; }
+    QSqlDatabase database();
 
     /**
       Sets the current session id.
@@ -282,6 +297,9 @@ protected:
                           const QSet<Entity::Id> &existing, const Collection &col,
                           bool silent );
 
+    /** Drops the cached statistics of all collections containing @p items. */
+    void invalidateCollectionStatistics( const PimItem::List &items );
+
     /** Converts the given date/time to the database format, i.e.
         "YYYY-MM-DD HH:MM:SS".
         @param dateTime the date/time in UTC
@@ -323,6 +341,13 @@ protected:
      */
     QSqlQuery retryLastTransaction( bool rollbackFirst );
 
+  private:
+    /**
+      Opens the database connection again if it has been released by
+      releaseConnection(). Returns whether the database is opened.
+    */
+    bool ensureOpened();
+
   private Q_SLOTS:
     void sendKeepAliveQuery();
 
@@ -332,6 +357,7 @@ protected:
     QString m_connectionName;
     QSqlDatabase m_database;
     bool m_dbOpened;
+    bool m_connectionReleased;
     uint m_transactionLevel;
     QVector<QPair<QSqlQuery,bool /* isBatch */> > m_transactionQueries;
     QByteArray mSessionId;
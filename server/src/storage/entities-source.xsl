@@ -100,24 +100,22 @@ class <xsl:value-of select="$className"/>::Private : public QSharedData
 
     // cache
     static bool cacheEnabled;
-    static QMutex cacheMutex;
     <xsl:if test="column[@name = 'id']">
-    static QHash&lt;qint64, <xsl:value-of select="$className"/> &gt; idCache;
+    static EntityCache&lt;qint64, <xsl:value-of select="$className"/> &gt; idCache;
     </xsl:if>
     <xsl:if test="column[@name = 'name']">
-    static QHash&lt;<xsl:value-of select="column[@name = 'name']/@type"/>, <xsl:value-of select="$className"/> &gt; nameCache;
+    static EntityCache&lt;<xsl:value-of select="column[@name = 'name']/@type"/>, <xsl:value-of select="$className"/> &gt; nameCache;
     </xsl:if>
 };
 
 
 // static members
 bool <xsl:value-of select="$className"/>::Private::cacheEnabled = false;
-QMutex <xsl:value-of select="$className"/>::Private::cacheMutex;
 <xsl:if test="column[@name = 'id']">
-QHash&lt;qint64, <xsl:value-of select="$className"/> &gt; <xsl:value-of select="$className"/>::Private::idCache;
+EntityCache&lt;qint64, <xsl:value-of select="$className"/> &gt; <xsl:value-of select="$className"/>::Private::idCache;
 </xsl:if>
 <xsl:if test="column[@name = 'name']">
-QHash&lt;<xsl:value-of select="column[@name = 'name']/@type"/>, <xsl:value-of select="$className"/> &gt; <xsl:value-of select="$className"/>::Private::nameCache;
+EntityCache&lt;<xsl:value-of select="column[@name = 'name']/@type"/>, <xsl:value-of select="$className"/> &gt; <xsl:value-of select="$className"/>::Private::nameCache;
 </xsl:if>
 
 
@@ -125,14 +123,12 @@ void <xsl:value-of select="$className"/>::Private::addToCache( const <xsl:value-
 {
   Q_ASSERT( cacheEnabled );
   Q_UNUSED( entry ); <!-- in case the table has neither an id nor name column -->
-  cacheMutex.lock();
   <xsl:if test="column[@name = 'id']">
   idCache.insert( entry.id(), entry );
   </xsl:if>
   <xsl:if test="column[@name = 'name']">
   nameCache.insert( entry.name(), entry );
   </xsl:if>
-  cacheMutex.unlock();
 }
 
 
@@ -258,13 +254,8 @@ int <xsl:value-of select="$className"/>::count( const QString &amp;column, const
 <xsl:if test="column[@name = 'id']">
 bool <xsl:value-of select="$className"/>::exists( qint64 id )
 {
-  if ( Private::cacheEnabled ) {
-    Private::cacheMutex.lock();
-    if ( Private::idCache.contains( id ) ) {
-      Private::cacheMutex.unlock();
-      return true;
-    }
-    Private::cacheMutex.unlock();
+  if ( Private::cacheEnabled &amp;&amp; Private::idCache.contains( id ) ) {
+    return true;
   }
   return count( idColumn(), id ) > 0;
 }
@@ -272,13 +263,8 @@ bool <xsl:value-of select="$className"/>::exists( qint64 id )
 <xsl:if test="column[@name = 'name']">
 bool <xsl:value-of select="$className"/>::exists( const <xsl:value-of select="column[@name = 'name']/@type"/> &amp;name )
 {
-  if ( Private::cacheEnabled ) {
-    Private::cacheMutex.lock();
-    if ( Private::nameCache.contains( name ) ) {
-      Private::cacheMutex.unlock();
-      return true;
-    }
-    Private::cacheMutex.unlock();
+  if ( Private::cacheEnabled &amp;&amp; Private::nameCache.contains( name ) ) {
+    return true;
   }
   return count( nameColumn(), name ) > 0;
 }
@@ -341,6 +327,7 @@ QVector&lt;<xsl:value-of select="$className"/>&gt; <xsl:value-of select="$classN
 
   QueryBuilder qb( tableName(), QueryBuilder::Select );
   qb.addColumns( columnNames() );
+  qb.setStatementShape( "<xsl:value-of select="$className"/>::retrieveAll" );
   if ( !qb.exec() ) {
     akDebug() &lt;&lt; "Error during selection of all records from table" &lt;&lt; tableName()
       &lt;&lt; qb.query().lastError().text() &lt;&lt; qb.query().lastQuery();
@@ -416,6 +403,7 @@ QVector&lt;<xsl:value-of select="$rightSideClass"/>&gt; <xsl:value-of select="$c
               QLatin1String("<xsl:value-of select="$relationName"/>.<xsl:value-of select="@table2"/>_<xsl:value-of select="@column2"/>"),
               QLatin1String("<xsl:value-of select="$rightSideTable"/>.<xsl:value-of select="@column2"/>") );
   qb.addValueCondition( QLatin1String("<xsl:value-of select="$relationName"/>.<xsl:value-of select="@table1"/>_<xsl:value-of select="@column1"/>"), Query::Equals, id() );
+  qb.setStatementShape( "<xsl:value-of select="$className"/>::<xsl:value-of select="@table2"/>s" );
 
   if ( !qb.exec() ) {
     akDebug() &lt;&lt; "Error during selection of records from table <xsl:value-of select="@table1"/><xsl:value-of select="@table2"/>Relation"
@@ -581,28 +569,24 @@ bool <xsl:value-of select="$className"/>::remove( qint64 id )
 void <xsl:value-of select="$className"/>::invalidateCache() const
 {
   if ( Private::cacheEnabled ) {
-    Private::cacheMutex.lock();
     <xsl:if test="column[@name = 'id']">
     Private::idCache.remove( id() );
     </xsl:if>
     <xsl:if test="column[@name = 'name']">
     Private::nameCache.remove( name() );
     </xsl:if>
-    Private::cacheMutex.unlock();
   }
 }
 
 void <xsl:value-of select="$className"/>::invalidateCompleteCache()
 {
   if ( Private::cacheEnabled ) {
-    Private::cacheMutex.lock();
     <xsl:if test="column[@name = 'id']">
     Private::idCache.clear();
     </xsl:if>
     <xsl:if test="column[@name = 'name']">
     Private::nameCache.clear();
     </xsl:if>
-    Private::cacheMutex.unlock();
   }
 }
 
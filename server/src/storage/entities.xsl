@@ -91,6 +91,7 @@ Q_DECLARE_TYPEINFO( Akonadi::Server::<xsl:value-of select="@name"/>, Q_MOVABLE_T
 <xsl:if test="$code='source'">
 #include &lt;entities.h&gt;
 #include &lt;storage/datastore.h&gt;
+#include &lt;storage/entitycache.h&gt;
 #include &lt;storage/selectquerybuilder.h&gt;
 #include &lt;utils.h&gt;
 
@@ -100,7 +101,6 @@ Q_DECLARE_TYPEINFO( Akonadi::Server::<xsl:value-of select="@name"/>, Q_MOVABLE_T
 #include &lt;qsqlerror.h&gt;
 #include &lt;qvariant.h&gt;
 #include &lt;QtCore/QHash&gt;
-#include &lt;QtCore/QMutex&gt;
 
 using namespace Akonadi::Server;
 
@@ -167,13 +167,10 @@ set<xsl:value-of select="$methodName"/>( <xsl:call-template name="argument"/> )
 <xsl:variable name="className"><xsl:value-of select="@name"/></xsl:variable>
   <xsl:if test="$cache != ''">
   if ( Private::cacheEnabled ) {
-    Private::cacheMutex.lock();
-    if ( Private::<xsl:value-of select="$cache"/>.contains( <xsl:value-of select="$key"/> ) ) {
-      const <xsl:value-of select="$className"/> tmp = Private::<xsl:value-of select="$cache"/>.value( <xsl:value-of select="$key"/> );
-      Private::cacheMutex.unlock();
-      return tmp;
+    <xsl:value-of select="$className"/> cached;
+    if ( Private::<xsl:value-of select="$cache"/>.find( <xsl:value-of select="$key"/>, cached ) ) {
+      return cached;
     }
-    Private::cacheMutex.unlock();
   }
   </xsl:if>
   QSqlDatabase db = DataStore::self()->database();
@@ -183,6 +180,7 @@ set<xsl:value-of select="$methodName"/>( <xsl:call-template name="argument"/> )
   QueryBuilder qb( tableName(), QueryBuilder::Select );
   qb.addColumns( columnNames() );
   qb.addValueCondition( QLatin1String("<xsl:value-of select="$key"/>"), Query::Equals, <xsl:value-of select="$key"/> );
+  qb.setStatementShape( "<xsl:value-of select="$className"/>::retrieveBy<xsl:value-of select="$key"/>" );
   if ( !qb.exec() ) {
     akDebug() &lt;&lt; "Error during selection of record with <xsl:value-of select="$key"/>"
       &lt;&lt; <xsl:value-of select="$key"/> &lt;&lt; "from table" &lt;&lt; tableName()
@@ -0,0 +1,120 @@
+/*
+    Copyright (c) 2014 Akonadi developers
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+#ifndef AKONADI_ENTITYCACHE_H
+#define AKONADI_ENTITYCACHE_H
+
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
+
+namespace Akonadi {
+namespace Server {
+
+/**
+ * Thread-safe cache used by the generated entity classes.
+ *
+ * The entries are spread over a fixed number of stripes by the hash of their
+ * key, each stripe being a hash protected by its own mutex. A lookup or a
+ * modification locks only the stripe of its key, once, so threads working on
+ * different entries rarely contend, and modifications never copy more than
+ * the entry itself.
+ */
+template <typename Key, typename T>
+class EntityCache
+{
+  public:
+    EntityCache()
+    {
+    }
+
+    /**
+     * Looks up the entry for @p key and copies it into @p value.
+     * Returns @c false if there is no such entry.
+     */
+    bool find( const Key &key, T &value ) const
+    {
+      const Stripe &stripe = stripeFor( key );
+      QMutexLocker locker( &stripe.lock );
+      typename QHash<Key, T>::const_iterator it = stripe.entries.constFind( key );
+      if ( it == stripe.entries.constEnd() ) {
+        return false;
+      }
+      value = it.value();
+      return true;
+    }
+
+    bool contains( const Key &key ) const
+    {
+      const Stripe &stripe = stripeFor( key );
+      QMutexLocker locker( &stripe.lock );
+      return stripe.entries.contains( key );
+    }
+
+    void insert( const Key &key, const T &value )
+    {
+      Stripe &stripe = stripeFor( key );
+      QMutexLocker locker( &stripe.lock );
+      stripe.entries.insert( key, value );
+    }
+
+    void remove( const Key &key )
+    {
+      Stripe &stripe = stripeFor( key );
+      QMutexLocker locker( &stripe.lock );
+      stripe.entries.remove( key );
+    }
+
+    void clear()
+    {
+      for ( int i = 0; i < StripeCount; ++i ) {
+        QMutexLocker locker( &mStripes[i].lock );
+        mStripes[i].entries.clear();
+      }
+    }
+
+  private:
+    enum {
+      StripeCount = 16
+    };
+
+    struct Stripe
+    {
+      mutable QMutex lock;
+      QHash<Key, T> entries;
+    };
+
+    Stripe &stripeFor( const Key &key )
+    {
+      return mStripes[qHash( key ) % StripeCount];
+    }
+
+    const Stripe &stripeFor( const Key &key ) const
+    {
+      return mStripes[qHash( key ) % StripeCount];
+    }
+
+    Stripe mStripes[StripeCount];
+
+    Q_DISABLE_COPY( EntityCache )
+};
+
+} // namespace Server
+} // namespace Akonadi
+
+#endif
@@ -22,87 +22,217 @@
 #include "itemretrievalrequest.h"
 
 #include <qdbusabstractinterface.h>
+#include <qdbusconnection.h>
+#include <qdbusmessage.h>
 #include <qdebug.h>
 
+#ifndef QT5_BUILD
+// registered by QtDBus already, but not declared in its public headers
+Q_DECLARE_METATYPE( QList<qlonglong> )
+#endif
+
 using namespace Akonadi::Server;
 
+// D-Bus timeouts for requesting a whole batch: the resource might have to download
+// every item of it, so give it more time than for a single item, depending on the size
+static const int s_minBatchTimeout = 5 * 60 * 1000;
+static const int s_batchTimeoutPerItem = 30 * 1000;
+
+ItemRetrievalJob::ItemRetrievalJob( const QList<ItemRetrievalRequest *> &requests, QObject *parent )
+  : QObject( parent )
+  , m_requests( requests )
+  , m_active( false )
+  , m_interface( 0 )
+  , m_method( BatchMethod )
+  , m_currentItem( 0 )
+{
+  Q_ASSERT( !m_requests.isEmpty() );
+  m_resourceId = m_requests.first()->resourceId;
+
+  Q_FOREACH ( ItemRetrievalRequest *request, m_requests ) {
+    Q_ASSERT( request->resourceId == m_resourceId );
+    int index = m_ids.indexOf( request->id );
+    if ( index < 0 ) {
+      m_ids << request->id;
+      m_remoteIds << QString::fromUtf8( request->remoteId );
+      m_mimeTypes << QString::fromUtf8( request->mimeType );
+      m_itemParts << QStringList();
+      index = m_ids.size() - 1;
+    }
+    Q_FOREACH ( const QString &part, request->parts ) {
+      if ( !m_itemParts[index].contains( part ) ) {
+        m_itemParts[index] << part;
+      }
+      if ( !m_parts.contains( part ) ) {
+        m_parts << part;
+      }
+    }
+  }
+}
+
 ItemRetrievalJob::~ItemRetrievalJob()
 {
   Q_ASSERT( !m_active );
 }
 
-void ItemRetrievalJob::start( QDBusAbstractInterface *interface )
+QString ItemRetrievalJob::resourceId() const
 {
-  Q_ASSERT( m_request );
-  akDebug() << "processing retrieval request for item" << m_request->id << " parts:" << m_request->parts << " of resource:" << m_request->resourceId;
+  return m_resourceId;
+}
+
+ItemRetrievalJob::Method ItemRetrievalJob::method() const
+{
+  return m_method;
+}
+
+void ItemRetrievalJob::start( QDBusAbstractInterface *interface, Method method )
+{
+  akDebug() << "processing retrieval request for items" << m_ids << " parts:" << m_parts << " of resource:" << m_resourceId;
 
   m_interface = interface;
+  m_method = method;
   // call the resource
   if ( interface ) {
     m_active = true;
-    m_oldMethodCalled = false;
-    QList<QVariant> arguments;
-    arguments << m_request->id
-              << QString::fromUtf8( m_request->remoteId )
-              << QString::fromUtf8( m_request->mimeType )
-              << m_request->parts;
-    interface->callWithCallback( QLatin1String( "requestItemDeliveryV2" ), arguments, this, SLOT(callFinished(QString)), SLOT(callFailed(QDBusError)) );
+    if ( m_method == BatchMethod ) {
+      requestItems();
+    } else {
+      m_currentItem = 0;
+      requestCurrentItem();
+    }
   } else {
-    Q_EMIT requestCompleted( m_request, QString::fromLatin1( "Unable to contact resource" ) );
+    completeRequests( QString::fromLatin1( "Unable to contact resource" ) );
+    Q_EMIT finished( this );
     deleteLater();
   }
 }
 
+void ItemRetrievalJob::requestItems()
+{
+  Q_ASSERT( m_interface );
+  QDBusMessage message = QDBusMessage::createMethodCall( m_interface->service(), m_interface->path(),
+                                                         m_interface->interface(), QLatin1String( "requestItemsDelivery" ) );
+  // sent as QList<qlonglong>, which QtDBus marshalls as "ax" without registering any type
+  message << QVariant::fromValue( m_ids.toList() )
+          << m_remoteIds
+          << m_mimeTypes
+          << m_parts;
+  const int timeout = qMax( s_minBatchTimeout, m_ids.size() * s_batchTimeoutPerItem );
+  m_interface->connection().callWithCallback( message, this, SLOT(callFinished(QString)), SLOT(callFailed(QDBusError)), timeout );
+}
+
+void ItemRetrievalJob::requestCurrentItem()
+{
+  Q_ASSERT( m_interface );
+  Q_ASSERT( m_currentItem < m_ids.size() );
+  QList<QVariant> arguments;
+  arguments << m_ids.at( m_currentItem )
+            << m_remoteIds.at( m_currentItem )
+            << m_mimeTypes.at( m_currentItem )
+            << m_itemParts.at( m_currentItem );
+  if ( m_method == SingleItemMethodV2 ) {
+    m_interface->callWithCallback( QLatin1String( "requestItemDeliveryV2" ), arguments, this, SLOT(callFinished(QString)), SLOT(callFailed(QDBusError)) );
+  } else {
+    akDebug() << "processing retrieval request (old method) for item" << m_ids.at( m_currentItem ) << " parts:" << m_itemParts.at( m_currentItem ) << " of resource:" << m_resourceId;
+    m_interface->callWithCallback( QLatin1String( "requestItemDelivery" ), arguments, this, SLOT(callFinished(bool)), SLOT(callFailed(QDBusError)) );
+  }
+}
+
 void ItemRetrievalJob::kill()
 {
   m_active = false;
-  Q_EMIT requestCompleted( m_request, QLatin1String( "Request cancelled" ) );
+  completeRequests( QLatin1String( "Request cancelled" ) );
+  Q_EMIT finished( this );
 }
 
-void ItemRetrievalJob::callFinished( bool returnValue )
+void ItemRetrievalJob::completeRequests( const QString &errorMsg, qint64 id )
 {
-  if ( m_active ) {
-    m_active = false;
-    if ( !returnValue ) {
-      Q_EMIT requestCompleted( m_request, QString::fromLatin1( "Resource was unable to deliver item" ) );
+  QList<ItemRetrievalRequest *> completed;
+  for ( QList<ItemRetrievalRequest *>::Iterator it = m_requests.begin(); it != m_requests.end(); ) {
+    if ( id < 0 || ( *it )->id == id ) {
+      completed << *it;
+      it = m_requests.erase( it );
     } else {
-      Q_EMIT requestCompleted( m_request, QString() );
+      ++it;
     }
   }
+  if ( !completed.isEmpty() ) {
+    Q_EMIT requestsCompleted( completed, errorMsg );
+  }
+}
+
+void ItemRetrievalJob::itemCompleted( const QString &errorMsg )
+{
+  completeRequests( errorMsg, m_ids.at( m_currentItem ) );
+  ++m_currentItem;
+  if ( m_currentItem < m_ids.size() ) {
+    requestCurrentItem();
+  } else {
+    done();
+  }
+}
+
+void ItemRetrievalJob::done()
+{
+  m_active = false;
+  Q_EMIT finished( this );
   deleteLater();
 }
 
+void ItemRetrievalJob::callFinished( bool returnValue )
+{
+  if ( !m_active ) {
+    deleteLater();
+    return;
+  }
+
+  if ( !returnValue ) {
+    itemCompleted( QString::fromLatin1( "Resource was unable to deliver item" ) );
+  } else {
+    itemCompleted( QString() );
+  }
+}
+
 void ItemRetrievalJob::callFinished( const QString &errorMsg )
 {
-  if ( m_active ) {
-    m_active = false;
-    if ( !errorMsg.isEmpty() ) {
-      Q_EMIT requestCompleted( m_request, QString::fromLatin1( "Unable to retrieve item from resource: %1" ).arg( errorMsg ) );
-    } else {
-      Q_EMIT requestCompleted( m_request, QString() );
-    }
+  if ( !m_active ) {
+    deleteLater();
+    return;
+  }
+
+  const QString error = errorMsg.isEmpty() ? QString() : QString::fromLatin1( "Unable to retrieve item from resource: %1" ).arg( errorMsg );
+  if ( m_method == BatchMethod ) {
+    completeRequests( error );
+    done();
+  } else {
+    itemCompleted( error );
   }
-  deleteLater();
 }
 
 void ItemRetrievalJob::callFailed( const QDBusError &error )
 {
-  if ( error.type() == QDBusError::UnknownMethod && !m_oldMethodCalled ) {
-    akDebug() << "processing retrieval request (old method) for item" << m_request->id << " parts:" << m_request->parts << " of resource:" << m_request->resourceId;
-    Q_ASSERT( m_interface );
-    //try the old version
-    QList<QVariant> arguments;
-    arguments << m_request->id
-              << QString::fromUtf8( m_request->remoteId )
-              << QString::fromUtf8( m_request->mimeType )
-              << m_request->parts;
-    m_oldMethodCalled = true;
-    m_interface->callWithCallback( QLatin1String( "requestItemDelivery" ), arguments, this, SLOT(callFinished(bool)), SLOT(callFailed(QDBusError)) );
+  if ( !m_active ) {
+    deleteLater();
     return;
   }
-  if ( m_active ) {
-    m_active = false;
-    Q_EMIT requestCompleted( m_request, QString::fromLatin1( "Unable to retrieve item from resource: %1" ).arg( error.message() ) );
+
+  if ( error.type() == QDBusError::UnknownMethod && m_method != SingleItemMethod ) {
+    // the resource does not support this method yet, fall back to the older one
+    if ( m_method == BatchMethod ) {
+      m_method = SingleItemMethodV2;
+      m_currentItem = 0;
+    } else {
+      m_method = SingleItemMethod;
+    }
+    requestCurrentItem();
+    return;
+  }
+
+  const QString errorMsg = QString::fromLatin1( "Unable to retrieve item from resource: %1" ).arg( error.message() );
+  if ( m_method == BatchMethod ) {
+    completeRequests( errorMsg );
+    done();
+  } else {
+    itemCompleted( errorMsg );
   }
-  deleteLater();
 }
@@ -21,6 +21,8 @@
 #define ITEMRETRIEVALJOB_H
 
 #include <QObject>
+#include <QStringList>
+#include <QVector>
 
 class QDBusAbstractInterface;
 class QDBusError;
@@ -30,25 +32,53 @@ namespace Server {
 
 class ItemRetrievalRequest;
 
-/// Async D-Bus retrieval, no modification of the request (thus no need for locking)
+/**
+  Async D-Bus retrieval of a batch of items of one resource, no modification
+  of the requests (thus no need for locking).
+
+  The whole batch is requested with a single requestItemsDelivery() call, if
+  the resource does not support that yet, the items are requested one after
+  the other using requestItemDeliveryV2() or requestItemDelivery().
+
+  requestItemsDelivery( ax uids, as remoteIds, as mimeTypes, as parts ) -> s is
+  not part of the installed org.freedesktop.Akonadi.Resource interface description,
+  so that resource adaptors generated from it are not affected. It is called
+  dynamically, resources not exporting it reply with an UnknownMethod error.
+*/
 class ItemRetrievalJob : public QObject
 {
   Q_OBJECT
   public:
-    ItemRetrievalJob( ItemRetrievalRequest *req, QObject *parent )
-      : QObject( parent )
-      , m_request( req )
-      , m_active( false )
-      , m_interface( 0 )
-      , m_oldMethodCalled( false )
-    {
-    }
+    /** D-Bus methods used to request items, newest first. */
+    enum Method {
+      BatchMethod,
+      SingleItemMethodV2,
+      SingleItemMethod
+    };
+
+    /**
+      Creates a job retrieving @p requests, which all have to belong to the
+      same resource. Requests for the same item are merged.
+    */
+    ItemRetrievalJob( const QList<ItemRetrievalRequest *> &requests, QObject *parent );
     ~ItemRetrievalJob();
-    void start( QDBusAbstractInterface *interface );
+    /**
+      Starts requesting the items from the resource using @p method, or an
+      older method if the resource turns out not to support it.
+    */
+    void start( QDBusAbstractInterface *interface, Method method = BatchMethod );
     void kill();
 
+    QString resourceId() const;
+
+    /** Returns the newest method supported by the resource, as far as known to this job. */
+    Method method() const;
+
   Q_SIGNALS:
-    void requestCompleted( ItemRetrievalRequest *req, const QString &errorMsg );
+    /** Emitted whenever some of the requests of this job have been processed. */
+    void requestsCompleted( const QList<ItemRetrievalRequest *> &requests, const QString &errorMsg );
+    /** Emitted once all requests of this job have been processed. */
+    void finished( ItemRetrievalJob *job );
 
   private Q_SLOTS:
     void callFinished( bool returnValue );
@@ -56,10 +86,23 @@ class ItemRetrievalJob : public QObject
     void callFailed( const QDBusError &error );
 
   private:
-    ItemRetrievalRequest *m_request;
+    void requestItems();
+    void requestCurrentItem();
+    void itemCompleted( const QString &errorMsg );
+    void completeRequests( const QString &errorMsg, qint64 id = -1 );
+    void done();
+
+    QList<ItemRetrievalRequest *> m_requests;
+    QString m_resourceId;
+    QVector<qint64> m_ids;
+    QStringList m_remoteIds;
+    QStringList m_mimeTypes;
+    QVector<QStringList> m_itemParts;
+    QStringList m_parts;
     bool m_active;
     QDBusAbstractInterface *m_interface;
-    bool m_oldMethodCalled;
+    Method m_method;
+    int m_currentItem;
 };
 
 } // namespace Server
@@ -32,13 +32,15 @@
 #include <QWaitCondition>
 #include <QDBusConnection>
 #include <QDBusConnectionInterface>
-
-#include <boost/scoped_ptr.hpp>
+#include <QSet>
 
 using namespace Akonadi::Server;
 
 ItemRetrievalManager *ItemRetrievalManager::sInstance = 0;
 
+/// Maximum number of distinct items sent to a resource in a single request
+static const int s_maxBatchSize = 100;
+
 ItemRetrievalManager::ItemRetrievalManager( QObject *parent )
   : QObject( parent ),
     mDBusConnection( DBusConnectionPool::threadConnection() )
@@ -82,6 +84,8 @@ void ItemRetrievalManager::serviceOwnerChanged( const QString &serviceName, cons
   }
   akDebug() << "Lost connection to resource" << serviceName << ", discarding cached interface";
   mResourceInterfaces.remove( resourceId );
+  // the resource might support newer methods after a restart
+  mRetrievalMethods.remove( resourceId );
 }
 
 // called within the retrieval thread
@@ -129,38 +133,106 @@ void ItemRetrievalManager::requestItemDelivery( qint64 uid, const QByteArray &re
 
 void ItemRetrievalManager::requestItemDelivery( ItemRetrievalRequest *req )
 {
+  requestItemDelivery( QList<ItemRetrievalRequest *>() << req );
+}
+
+void ItemRetrievalManager::requestItemDelivery( const QList<ItemRetrievalRequest *> &requests )
+{
+  postItemDelivery( requests );
+
+  QList<ItemRetrievalRequest *> pending = requests;
+  QString errorMsg;
+  while ( !pending.isEmpty() ) {
+    Q_FOREACH ( ItemRetrievalRequest *req, waitForItemDelivery( pending ) ) {
+      if ( errorMsg.isEmpty() ) {
+        errorMsg = req->errorMsg;
+      }
+    }
+  }
+  qDeleteAll( requests );
+
+  if ( !errorMsg.isEmpty() ) {
+    throw ItemRetrieverException( errorMsg );
+  }
+}
+
+// called from any thread
+void ItemRetrievalManager::postItemDelivery( const QList<ItemRetrievalRequest *> &requests )
+{
+  if ( requests.isEmpty() ) {
+    return;
+  }
+
   mLock->lockForWrite();
-  akDebug() << "posting retrieval request for item" << req->id << " there are "
-            << mPendingRequests.size() << " queues and "
-            << mPendingRequests[req->resourceId].size() << " items in mine";
-  mPendingRequests[req->resourceId].append( req );
+  Q_FOREACH ( ItemRetrievalRequest *req, requests ) {
+    akDebug() << "posting retrieval request for item" << req->id << " there are "
+              << mPendingRequests.size() << " queues and "
+              << mPendingRequests[req->resourceId].size() << " items in mine";
+    mPendingRequests[req->resourceId].append( req );
+  }
   mLock->unlock();
 
   Q_EMIT requestAdded();
+}
+
+// called from any thread
+QList<ItemRetrievalRequest *> ItemRetrievalManager::waitForItemDelivery( QList<ItemRetrievalRequest *> &pending )
+{
+  QList<ItemRetrievalRequest *> processed;
 
   mLock->lockForRead();
   Q_FOREVER {
-    //akDebug() << "checking if request for item" << req->id << "has been processed...";
-    if ( req->processed ) {
-      boost::scoped_ptr<ItemRetrievalRequest> reqDeleter( req );
-      Q_ASSERT( !mPendingRequests[req->resourceId].contains( req ) );
-      const QString errorMsg = req->errorMsg;
-      mLock->unlock();
-      if ( errorMsg.isEmpty() ) {
-        akDebug() << "request for item" << req->id << "succeeded";
-        return;
+    //akDebug() << "checking if requests have been processed...";
+    for ( QList<ItemRetrievalRequest *>::Iterator it = pending.begin(); it != pending.end(); ) {
+      if ( ( *it )->processed ) {
+        Q_ASSERT( !mPendingRequests.value( ( *it )->resourceId ).contains( *it ) );
+        processed << *it;
+        it = pending.erase( it );
       } else {
-        akDebug() << "request for item" << req->id << req->remoteId << "failed:" << errorMsg;
-        throw ItemRetrieverException( errorMsg );
+        ++it;
       }
+    }
+    if ( !processed.isEmpty() || pending.isEmpty() ) {
+      break;
+    }
+    akDebug() << "requests for" << pending.size() << "items still pending - waiting";
+    mWaitCondition->wait( mLock );
+    akDebug() << "continuing";
+  }
+  mLock->unlock();
+
+  Q_FOREACH ( ItemRetrievalRequest *req, processed ) {
+    if ( req->errorMsg.isEmpty() ) {
+      akDebug() << "request for item" << req->id << "succeeded";
     } else {
-      akDebug() << "request for item" << req->id << "still pending - waiting";
-      mWaitCondition->wait( mLock );
-      akDebug() << "continuing";
+      akDebug() << "request for item" << req->id << req->remoteId << "failed:" << req->errorMsg;
     }
   }
 
-  throw ItemRetrieverException( "WTF?" );
+  return processed;
+}
+
+// called within the retrieval thread, with mLock locked for writing
+QList<ItemRetrievalRequest *> ItemRetrievalManager::takeRequestBatch( QList<ItemRetrievalRequest *> &queue )
+{
+  // Batch requests asking for the same parts, so that the resource can handle
+  // them in one go. Requests for an item that is already part of the batch are
+  // always taken, the job merges their parts.
+  const QSet<QString> parts = queue.first()->parts.toSet();
+  QList<ItemRetrievalRequest *> batch;
+  QSet<qint64> ids;
+  for ( QList<ItemRetrievalRequest *>::Iterator it = queue.begin(); it != queue.end(); ) {
+    ItemRetrievalRequest *req = *it;
+    if ( ids.contains( req->id ) ||
+         ( ids.size() < s_maxBatchSize && req->parts.toSet() == parts ) ) {
+      ids.insert( req->id );
+      batch << req;
+      it = queue.erase( it );
+    } else {
+      ++it;
+    }
+  }
+  return batch;
 }
 
 // called within the retrieval thread
@@ -176,14 +248,15 @@ void ItemRetrievalManager::processRequest()
       continue;
     }
     if ( !mCurrentJobs.contains( it.key() ) || mCurrentJobs.value( it.key() ) == 0 ) {
-      // TODO: check if there is another one for the same uid with more parts requested
-      ItemRetrievalRequest *req = it.value().takeFirst();
-      Q_ASSERT( req->resourceId == it.key() );
-      ItemRetrievalJob *job = new ItemRetrievalJob( req, this );
-      connect( job, SIGNAL(requestCompleted(ItemRetrievalRequest*,QString)), SLOT(retrievalJobFinished(ItemRetrievalRequest*,QString)) );
-      mCurrentJobs.insert( req->resourceId, job );
+      const QList<ItemRetrievalRequest *> requests = takeRequestBatch( it.value() );
+      ItemRetrievalJob *job = new ItemRetrievalJob( requests, this );
+      connect( job, SIGNAL(requestsCompleted(QList<ItemRetrievalRequest*>,QString)),
+               SLOT(retrievalJobFinished(QList<ItemRetrievalRequest*>,QString)) );
+      connect( job, SIGNAL(finished(ItemRetrievalJob*)),
+               SLOT(retrievalJobDone(ItemRetrievalJob*)) );
+      mCurrentJobs.insert( it.key(), job );
       // delay job execution until after we unlocked the mutex, since the job can emit the finished signal immediately in some cases
-      newJobs.append( qMakePair( job, req->resourceId ) );
+      newJobs.append( qMakePair( job, it.key() ) );
     }
     ++it;
   }
@@ -197,30 +270,47 @@ void ItemRetrievalManager::processRequest()
   }
 
   for ( QVector<QPair<ItemRetrievalJob *, QString> >::const_iterator it = newJobs.constBegin(); it != newJobs.constEnd(); ++it ) {
-    ( *it ).first->start( resourceInterface( ( *it ).second ) );
+    const ItemRetrievalJob::Method method
+      = static_cast<ItemRetrievalJob::Method>( mRetrievalMethods.value( ( *it ).second, ItemRetrievalJob::BatchMethod ) );
+    ( *it ).first->start( resourceInterface( ( *it ).second ), method );
   }
 }
 
-void ItemRetrievalManager::retrievalJobFinished( ItemRetrievalRequest *request, const QString &errorMsg )
+void ItemRetrievalManager::retrievalJobFinished( const QList<ItemRetrievalRequest *> &requests, const QString &errorMsg )
 {
   mLock->lockForWrite();
-  request->errorMsg = errorMsg;
-  request->processed = true;
-  Q_ASSERT( mCurrentJobs.contains( request->resourceId ) );
-  mCurrentJobs.remove( request->resourceId );
-  // TODO check if (*it)->parts is a subset of currentRequest->parts
-  for ( QList<ItemRetrievalRequest *>::Iterator it = mPendingRequests[request->resourceId].begin(); it != mPendingRequests[request->resourceId].end(); ) {
-    if ( ( *it )->id == request->id ) {
-      akDebug() << "someone else requested item" << request->id << "as well, marking as processed";
-      ( *it )->errorMsg = errorMsg;
-      ( *it )->processed = true;
-      it = mPendingRequests[request->resourceId].erase( it );
-    } else {
-      ++it;
+  Q_FOREACH ( ItemRetrievalRequest *request, requests ) {
+    request->errorMsg = errorMsg;
+    request->processed = true;
+
+    // requests for the same item that got queued in the meantime are done as well,
+    // as long as they don't ask for parts we did not retrieve
+    QList<ItemRetrievalRequest *> &pending = mPendingRequests[request->resourceId];
+    for ( QList<ItemRetrievalRequest *>::Iterator it = pending.begin(); it != pending.end(); ) {
+      if ( ( *it )->id == request->id && request->parts.toSet().contains( ( *it )->parts.toSet() ) ) {
+        akDebug() << "someone else requested item" << request->id << "as well, marking as processed";
+        ( *it )->errorMsg = errorMsg;
+        ( *it )->processed = true;
+        it = pending.erase( it );
+      } else {
+        ++it;
+      }
     }
   }
   mWaitCondition->wakeAll();
   mLock->unlock();
+}
+
+void ItemRetrievalManager::retrievalJobDone( ItemRetrievalJob *job )
+{
+  mLock->lockForWrite();
+  Q_ASSERT( mCurrentJobs.value( job->resourceId() ) == job );
+  mCurrentJobs.remove( job->resourceId() );
+  mLock->unlock();
+  // remember if the job had to fall back to an older method, so that the next ones use it right away
+  if ( job->method() != ItemRetrievalJob::BatchMethod ) {
+    mRetrievalMethods.insert( job->resourceId(), job->method() );
+  }
   Q_EMIT requestAdded(); // trigger processRequest() again, in case there is more in the queues
 }
 
@@ -55,6 +55,29 @@ class ItemRetrievalManager : public QObject
      */
     void requestItemDelivery( ItemRetrievalRequest *request );
 
+    /**
+     * Posts all @p requests at once and blocks until all of them have been
+     * processed. Requests for the same resource are sent to it in batches.
+     * ItemRetrievalManager takes ownership over the requests and deletes them
+     * once they are processed. If any of the requests fails, an
+     * ItemRetrieverException with the first error is thrown.
+     */
+    void requestItemDelivery( const QList<ItemRetrievalRequest *> &requests );
+
+    /**
+     * Posts @p requests without waiting for them to be processed. The caller
+     * keeps ownership of the requests, but must not delete them before they
+     * have been returned by waitForItemDelivery().
+     */
+    void postItemDelivery( const QList<ItemRetrievalRequest *> &requests );
+
+    /**
+     * Blocks until at least one of the @p pending requests has been processed,
+     * removes all processed requests from @p pending and returns them.
+     * Returns immediately if @p pending is empty.
+     */
+    QList<ItemRetrievalRequest *> waitForItemDelivery( QList<ItemRetrievalRequest *> &pending );
+
     static ItemRetrievalManager *instance();
 
   Q_SIGNALS:
@@ -62,13 +85,15 @@ class ItemRetrievalManager : public QObject
 
   private:
     OrgFreedesktopAkonadiResourceInterface *resourceInterface( const QString &id );
+    static QList<ItemRetrievalRequest *> takeRequestBatch( QList<ItemRetrievalRequest *> &queue );
 
   private Q_SLOTS:
     void serviceOwnerChanged( const QString &serviceName, const QString &oldOwner, const QString &newOwner );
     void processRequest();
     void triggerCollectionSync( const QString &resource, qint64 colId );
     void triggerCollectionTreeSync( const QString &resource );
-    void retrievalJobFinished( ItemRetrievalRequest *request, const QString &errorMsg );
+    void retrievalJobFinished( const QList<ItemRetrievalRequest *> &requests, const QString &errorMsg );
+    void retrievalJobDone( ItemRetrievalJob *job );
 
   private:
     static ItemRetrievalManager *sInstance;
@@ -80,6 +105,8 @@ class ItemRetrievalManager : public QObject
     QHash<QString, QList<ItemRetrievalRequest *> > mPendingRequests;
     /// Currently running jobs, one per resource
     QHash<QString, ItemRetrievalJob *> mCurrentJobs;
+    /// Retrieval methods of resources known not to support the newest one, only used within the retrieval thread
+    QHash<QString, int> mRetrievalMethods;
 
     // resource dbus interface cache
     QHash<QString, OrgFreedesktopAkonadiResourceInterface *> mResourceInterfaces;
@@ -29,6 +29,7 @@
 #include "storage/parthelper.h"
 #include "storage/parttypehelper.h"
 #include "storage/querybuilder.h"
+#include "storage/querycache.h"
 #include "storage/selectquerybuilder.h"
 #include "utils.h"
 
@@ -193,17 +194,17 @@ QSqlQuery ItemRetriever::buildQuery() const
   return qb.query();
 }
 
-bool ItemRetriever::exec()
+QList<ItemRetrievalRequest *> ItemRetriever::prepareRequests()
 {
+  QList<ItemRetrievalRequest *> requests;
   if ( mParts.isEmpty() && !mFullPayload ) {
-    return true;
+    return requests;
   }
 
   verifyCache();
 
   QSqlQuery query = buildQuery();
   ItemRetrievalRequest *lastRequest = 0;
-  QList<ItemRetrievalRequest *> requests;
 
   QStringList parts;
   Q_FOREACH ( const QString &part, mParts ) {
@@ -250,15 +251,35 @@ bool ItemRetriever::exec()
 
   query.finish();
 
-  Q_FOREACH ( ItemRetrievalRequest *request, requests ) {
-    if ( request->parts.isEmpty() ) {
-        delete request;
-        continue;
+  for ( QList<ItemRetrievalRequest *>::Iterator it = requests.begin(); it != requests.end(); ) {
+    if ( ( *it )->parts.isEmpty() ) {
+      delete *it;
+      it = requests.erase( it );
+    } else {
+      ++it;
     }
-    // TODO: how should we handle retrieval errors here? so far they have been ignored,
-    // which makes sense in some cases, do we need a command parameter for this?
+  }
+
+  return requests;
+}
+
+bool ItemRetriever::exec()
+{
+  if ( mParts.isEmpty() && !mFullPayload ) {
+    return true;
+  }
+
+  const QList<ItemRetrievalRequest *> requests = prepareRequests();
+
+  // post all requests at once, so that ItemRetrievalManager can send them to
+  // the resources in batches rather than one D-Bus roundtrip per item
+  // TODO: how should we handle retrieval errors here? so far they have been ignored,
+  // which makes sense in some cases, do we need a command parameter for this?
+  if ( !requests.isEmpty() ) {
+    // don't keep the tables locked while the resources store the retrieved parts
+    QueryCache::finishQueries();
     try {
-      ItemRetrievalManager::instance()->requestItemDelivery( request );
+      ItemRetrievalManager::instance()->requestItemDelivery( requests );
     } catch ( const ItemRetrieverException &e ) {
       akError() << e.type() << ": " << e.what();
       mLastError = e.what();
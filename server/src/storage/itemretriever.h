@@ -34,6 +34,7 @@ namespace Akonadi {
 namespace Server {
 
 class Connection;
+class ItemRetrievalRequest;
 class QueryBuilder;
 
 /**
@@ -67,6 +68,14 @@ class ItemRetriever
 
     bool exec();
 
+    /**
+      Determines which items in the scope are missing any of the requested parts
+      and returns a retrieval request for each of them, without sending them to
+      the resources. Child collections are not taken into account.
+      The caller takes ownership of the returned requests.
+    */
+    QList<ItemRetrievalRequest *> prepareRequests();
+
     QByteArray lastError() const;
 
   private:
@@ -25,6 +25,7 @@
 #include "intervalcheck.h"
 #include "search/searchmanager.h"
 #include "akonadi.h"
+#include "connection.h"
 #include "libs/notificationmessagev2_p_p.h"
 #include <search.h>
 
@@ -36,12 +37,14 @@ using namespace Akonadi::Server;
 NotificationCollector::NotificationCollector( QObject *parent )
   : QObject( parent )
   , mDb( 0 )
+  , mCollectionResourcesChanged( false )
 {
 }
 
 NotificationCollector::NotificationCollector( DataStore *db )
   : QObject( db )
   , mDb( db )
+  , mCollectionResourcesChanged( false )
 {
   connect( db, SIGNAL(transactionCommitted()), SLOT(transactionCommitted()) );
   connect( db, SIGNAL(transactionRolledBack()), SLOT(transactionRolledBack()) );
@@ -49,6 +52,7 @@ NotificationCollector::NotificationCollector( DataStore *db )
 
 NotificationCollector::~NotificationCollector()
 {
+  finishStatisticsChanges( false );
 }
 
 void NotificationCollector::itemAdded( const PimItem &item,
@@ -56,6 +60,7 @@ void NotificationCollector::itemAdded( const PimItem &item,
                                        const QByteArray &resource )
 {
   SearchManager::instance()->scheduleSearchUpdate();
+  collectionStatisticsChanged( collection.isValid() ? collection.id() : item.collectionId(), 1, item.size(), 0 );
   itemNotification( NotificationMessageV2::Add, item, collection, Collection(), resource );
 }
 
@@ -65,6 +70,7 @@ void NotificationCollector::itemChanged( const PimItem &item,
                                          const QByteArray &resource )
 {
   SearchManager::instance()->scheduleSearchUpdate();
+  invalidateCollectionStatistics( collection.isValid() ? collection.id() : item.collectionId() );
   itemNotification( NotificationMessageV2::Modify, item, collection, Collection(), resource, changedParts );
 }
 
@@ -101,6 +107,14 @@ void NotificationCollector::itemsMoved( const PimItem::List &items,
                                         const QByteArray &sourceResource )
 {
   SearchManager::instance()->scheduleSearchUpdate();
+  if ( collectionSrc.isValid() ) {
+    invalidateCollectionStatistics( collectionSrc.id() );
+  } else {
+    Q_FOREACH ( const PimItem &item, items ) {
+      invalidateCollectionStatistics( item.collectionId() );
+    }
+  }
+  invalidateCollectionStatistics( collectionDest.id() );
   itemNotification( NotificationMessageV2::Move, items, collectionSrc, collectionDest, sourceResource );
 }
 
@@ -108,6 +122,9 @@ void NotificationCollector::itemsRemoved( const PimItem::List &items,
                                           const Collection &collection,
                                           const QByteArray &resource )
 {
+  Q_FOREACH ( const PimItem &item, items ) {
+    invalidateCollectionStatistics( collection.isValid() ? collection.id() : item.collectionId() );
+  }
   itemNotification( NotificationMessageV2::Remove, items, collection, Collection(), resource );
 }
 
@@ -157,6 +174,9 @@ void NotificationCollector::collectionMoved( const Collection &collection,
   if ( AkonadiServer::instance()->intervalChecker() ) {
     AkonadiServer::instance()->intervalChecker()->collectionChanged( collection.id() );
   }
+  if ( resource != destResource ) {
+    invalidateCollectionResources();
+  }
   collectionNotification( NotificationMessageV2::Move, collection, source.id(), collection.parentId(), resource, QSet<QByteArray>(), destResource );
 }
 
@@ -169,6 +189,8 @@ void NotificationCollector::collectionRemoved( const Collection &collection,
   if ( AkonadiServer::instance()->intervalChecker() ) {
     AkonadiServer::instance()->intervalChecker()->collectionRemoved( collection.id() );
   }
+  invalidateCollectionStatistics( collection.id() );
+  invalidateCollectionResources();
   collectionNotification( NotificationMessageV2::Remove, collection, collection.parentId(), -1, resource );
 }
 
@@ -221,13 +243,89 @@ void NotificationCollector::relationRemoved(const Relation &relation)
     relationNotification(NotificationMessageV2::Remove, relation);
 }
 
+void NotificationCollector::collectionStatisticsChanged( Collection::Id collectionId,
+                                                         qint64 count, qint64 size, qint64 read )
+{
+  if ( !beginStatisticsChange( collectionId ) ) {
+    return;
+  }
+  CollectionStatistics::Statistics &delta = mStatisticsChanges[collectionId];
+  delta.count += count;
+  delta.size += size;
+  delta.read += read;
+}
+
+void NotificationCollector::invalidateCollectionStatistics( Collection::Id collectionId )
+{
+  if ( beginStatisticsChange( collectionId ) ) {
+    mInvalidatedStatistics.insert( collectionId );
+  }
+}
+
+bool NotificationCollector::beginStatisticsChange( Collection::Id collectionId )
+{
+  if ( collectionId < 0 ) {
+    return false;
+  }
+  // outside of a transaction we cannot tell whether the change has already
+  // been written, so just make sure the statistics are recalculated
+  if ( !mDb || !mDb->inTransaction() ) {
+    CollectionStatistics::self()->invalidateCollection( collectionId );
+    return false;
+  }
+  if ( !mStatisticsChanges.contains( collectionId ) ) {
+    CollectionStatistics::self()->beginChange( collectionId );
+    mStatisticsChanges.insert( collectionId, CollectionStatistics::Statistics() );
+  }
+  return true;
+}
+
+void NotificationCollector::finishStatisticsChanges( bool committed )
+{
+  if ( mStatisticsChanges.isEmpty() ) {
+    return;
+  }
+
+  CollectionStatistics *statistics = CollectionStatistics::self();
+  for ( QHash<Collection::Id, CollectionStatistics::Statistics>::const_iterator it = mStatisticsChanges.constBegin();
+        it != mStatisticsChanges.constEnd(); ++it ) {
+    if ( committed && !mInvalidatedStatistics.contains( it.key() ) ) {
+      statistics->commitChange( it.key(), it.value() );
+    } else {
+      statistics->abortChange( it.key() );
+    }
+  }
+  mStatisticsChanges.clear();
+  mInvalidatedStatistics.clear();
+}
+
+void NotificationCollector::invalidateCollectionResources()
+{
+  Connection::invalidateCollectionResources();
+  // other connections could look the old resource up again until the transaction is committed
+  if ( mDb && mDb->inTransaction() ) {
+    mCollectionResourcesChanged = true;
+  }
+}
+
 void NotificationCollector::transactionCommitted()
 {
+  finishStatisticsChanges( true );
+  if ( mCollectionResourcesChanged ) {
+    Connection::invalidateCollectionResources();
+    mCollectionResourcesChanged = false;
+  }
   dispatchNotifications();
 }
 
 void NotificationCollector::transactionRolledBack()
 {
+  finishStatisticsChanges( false );
+  // the connection running the transaction may have cached the uncommitted resource
+  if ( mCollectionResourcesChanged ) {
+    Connection::invalidateCollectionResources();
+    mCollectionResourcesChanged = false;
+  }
   clear();
 }
 
@@ -21,12 +21,14 @@
 #define AKONADI_NOTIFICATIONCOLLECTOR_H
 
 #include "entities.h"
+#include "collectionstatistics.h"
 
 #include "../../libs/notificationmessagev3_p.h"
 
 #include <QtCore/QByteArray>
 #include <QtCore/QList>
 #include <QtCore/QObject>
+#include <QtCore/QSet>
 #include <QtCore/QString>
 
 namespace Akonadi {
@@ -211,6 +213,21 @@ class NotificationCollector : public QObject
      */
     void relationRemoved(const Relation &relation);
 
+    /**
+      Notify about a change of the statistics of the collection @p collectionId
+      by the given amounts. The change is applied to the cached collection
+      statistics once the current transaction has been committed.
+     */
+    void collectionStatisticsChanged( Collection::Id collectionId,
+                                      qint64 count, qint64 size, qint64 read );
+
+    /**
+      Notify about a change of the statistics of the collection @p collectionId
+      that cannot be expressed as a delta. The statistics are recalculated
+      when needed.
+     */
+    void invalidateCollectionStatistics( Collection::Id collectionId );
+
     /**
       Trigger sending of collected notifications.
     */
@@ -250,6 +267,9 @@ class NotificationCollector : public QObject
                                              const Relation &relation);
     void dispatchNotification( const NotificationMessageV3 &msg );
     void clear();
+    bool beginStatisticsChange( Collection::Id collectionId );
+    void finishStatisticsChanges( bool committed );
+    void invalidateCollectionResources();
 
   private Q_SLOTS:
     void transactionCommitted();
@@ -260,6 +280,10 @@ class NotificationCollector : public QObject
     QByteArray mSessionId;
 
     NotificationMessageV3::List mNotifications;
+    QHash<Collection::Id, CollectionStatistics::Statistics> mStatisticsChanges;
+    QSet<Collection::Id> mInvalidatedStatistics;
+    /// whether collections were moved to another resource or removed in the current transaction
+    bool mCollectionResourcesChanged;
 };
 
 } // namespace Server
@@ -37,6 +37,15 @@
 
 #include <QSqlError>
 
+#ifdef Q_OS_UNIX
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#ifdef Q_OS_LINUX
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#endif
+
 using namespace Akonadi;
 using namespace Akonadi::Server;
 
@@ -153,6 +162,101 @@ bool PartHelper::insert( Part *part, qint64 *insertId )
   return result;
 }
 
+bool PartHelper::copyParts( PimItem::Id sourceItemId, PimItem::Id targetItemId )
+{
+  // internal payloads are duplicated by the database in a single statement
+  QueryBuilder qb( Part::tableName(), QueryBuilder::Insert );
+  qb.setColumnValue( Part::pimItemIdColumn(), targetItemId );
+  qb.addColumns( QStringList() << Part::partTypeIdColumn() << Part::dataColumn() << Part::datasizeColumn()
+                               << Part::versionColumn() << Part::externalColumn() );
+  qb.addValueCondition( Part::pimItemIdColumn(), Query::Equals, sourceItemId );
+  qb.addValueCondition( Part::externalColumn(), Query::Equals, false );
+  if ( !qb.exec() ) {
+    return false;
+  }
+
+  SelectQueryBuilder<Part> partQb;
+  partQb.addValueCondition( Part::pimItemIdColumn(), Query::Equals, sourceItemId );
+  partQb.addValueCondition( Part::externalColumn(), Query::Equals, true );
+  if ( !partQb.exec() ) {
+    return false;
+  }
+  const Part::List parts = partQb.result();
+  partQb.query().finish();
+
+  Q_FOREACH ( const Part &part, parts ) {
+    const QString sourcePath = resolveAbsolutePath( part.data() );
+    // same recovery as in verify(), a missing payload file doesn't fail the whole copy
+    const bool missing = !QFile::exists( sourcePath );
+    if ( missing ) {
+      akError() << "Copy: payload file" << sourcePath << "is missing, copying an empty part.";
+    }
+
+    // the new part id is needed for the payload file name
+    Part newPart;
+    newPart.setPimItemId( targetItemId );
+    newPart.setPartTypeId( part.partTypeId() );
+    newPart.setData( QByteArray() );
+    newPart.setDatasize( missing ? 0 : part.datasize() );
+    newPart.setVersion( part.version() );
+    newPart.setExternal( !missing );
+    if ( !newPart.insert() ) {
+      return false;
+    }
+    if ( missing ) {
+      continue;
+    }
+
+    const QString fileName = fileNameForPart( &newPart ) + QLatin1String( "_r0" );
+    if ( !cloneFile( sourcePath, storagePath() + fileName ) ) {
+      akError() << "Copy: payload file" << sourcePath << "could not be copied to" << fileName;
+      return false;
+    }
+    newPart.setData( fileName.toLocal8Bit() );
+    if ( !newPart.update() ) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool PartHelper::cloneFile( const QString &sourcePath, const QString &targetPath )
+{
+#ifdef Q_OS_UNIX
+  const QByteArray source = QFile::encodeName( sourcePath );
+  const QByteArray target = QFile::encodeName( targetPath );
+
+#ifdef FICLONE
+  // share the data blocks on file systems supporting reflinks
+  const int sourceFd = ::open( source.constData(), O_RDONLY );
+  if ( sourceFd >= 0 ) {
+    const int targetFd = ::open( target.constData(), O_WRONLY | O_CREAT | O_EXCL, 0666 );
+    if ( targetFd >= 0 ) {
+      const bool cloned = ::ioctl( targetFd, FICLONE, sourceFd ) == 0;
+      ::close( targetFd );
+      if ( !cloned ) {
+        ::unlink( target.constData() );
+      }
+      ::close( sourceFd );
+      if ( cloned ) {
+        return true;
+      }
+    } else {
+      ::close( sourceFd );
+    }
+  }
+#endif
+
+  // update() and the part streamer always write a new revision file and remove
+  // the old one, so payload files can be shared between parts
+  if ( ::link( source.constData(), target.constData() ) == 0 ) {
+    return true;
+  }
+#endif
+
+  return QFile::copy( sourcePath, targetPath );
+}
+
 bool PartHelper::remove( Part *part )
 {
   if ( !part ) {
@@ -261,6 +365,28 @@ bool PartHelper::truncate( Part &part )
   return part.update();
 }
 
+bool PartHelper::truncate( const QVariantList &partIds, QStringList &externalFiles )
+{
+  QueryBuilder fileQb( Part::tableName() );
+  fileQb.addColumn( Part::dataColumn() );
+  fileQb.addValueCondition( Part::idColumn(), Query::In, partIds );
+  fileQb.addValueCondition( Part::externalColumn(), Query::Equals, true );
+  if ( !fileQb.exec() ) {
+    return false;
+  }
+  while ( fileQb.query().next() ) {
+    externalFiles << resolveAbsolutePath( fileQb.query().value( 0 ).toByteArray() );
+  }
+  fileQb.query().finish();
+
+  QueryBuilder qb( Part::tableName(), QueryBuilder::Update );
+  qb.setColumnValue( Part::dataColumn(), QByteArray() );
+  qb.setColumnValue( Part::datasizeColumn(), 0 );
+  qb.setColumnValue( Part::externalColumn(), false );
+  qb.addValueCondition( Part::idColumn(), Query::In, partIds );
+  return qb.exec();
+}
+
 QString PartHelper::storagePath()
 {
   const QString dataDir = AkStandardDirs::saveDir( "data", QLatin1String( "file_db_data" ) ) + QDir::separator();
@@ -25,6 +25,7 @@
 #include "../exception.h"
 
 class QString;
+class QStringList;
 class QVariant;
 class QFile;
 
@@ -60,6 +61,21 @@ namespace PartHelper
    */
   bool insert( Part *part, qint64 *insertId = 0 );
 
+  /**
+   * Copies all parts of the item @p sourceItemId to the item @p targetItemId.
+   * Internal payloads are copied by the database, external payload files are
+   * cloned using cloneFile(), so no payload data passes through the server.
+   * Parts whose payload file is missing are copied as empty internal parts.
+   */
+  bool copyParts( PimItem::Id sourceItemId, PimItem::Id targetItemId );
+
+  /**
+   * Creates @p targetPath with the same content as @p sourcePath, sharing the
+   * data with the source file where possible (reflink, or a hardlink since payload
+   * files are never modified in place) and falling back to copying it.
+   */
+  bool cloneFile( const QString &sourcePath, const QString &targetPath );
+
   /** Deletes @p part from the database and also removes existing filesystem data if needed. */
   bool remove( Part *part );
   /** Deletes all parts which match the given constraint, including all corresponding filesystem data. */
@@ -88,6 +104,14 @@ namespace PartHelper
    */
   bool truncate( Part &part );
 
+  /** Truncates the payloads of all parts in @p partIds with a single update.
+   *  The absolute paths of the payload files of external parts are appended to
+   *  @p externalFiles, removing them is left to the caller.
+   *  Besides the ids, up to 3 more values are bound, so on SQLite @p partIds
+   *  must not contain more than 996 entries.
+   */
+  bool truncate( const QVariantList &partIds, QStringList &externalFiles );
+
   /** Verifies and if necessary fixes the external reference of this part. */
   bool verify( Part &part );
 
@@ -28,9 +28,47 @@
 
 #include <QSqlRecord>
 #include <QSqlError>
+#include <QtCore/QHash>
+#include <QtCore/QThreadStorage>
 
 using namespace Akonadi::Server;
 
+// Maximum number of rows inserted by a single multi-row INSERT
+static const int s_maxInsertRows = 1024;
+// Maximum number of values bound to a single multi-row INSERT, PostgreSQL can't
+// handle more than 32767 parameters per statement
+static const int s_maxInsertBindValues = 30000;
+
+static bool isBatchValue( const QVariant &value )
+{
+  return value.canConvert<QVariantList>();
+}
+
+namespace {
+
+/// A statement built for a query with a declared statement shape
+struct StatementShape
+{
+  QString statement;
+  DbType::Type databaseType;
+  int bindValueCount;
+};
+
+}
+
+typedef QHash<const char *, StatementShape> StatementShapeCache;
+
+// Statements of declared shapes, per thread so that no locking is needed
+static QThreadStorage<StatementShapeCache *> g_statementShapes;
+
+static StatementShapeCache *perThreadStatementShapes()
+{
+  if ( !g_statementShapes.hasLocalData() ) {
+    g_statementShapes.setLocalData( new StatementShapeCache() );
+  }
+  return g_statementShapes.localData();
+}
+
 static QString compareOperatorToString( Query::CompareOperator op )
 {
   switch ( op ) {
@@ -97,6 +135,9 @@ QueryBuilder::QueryBuilder( const QString &table, QueryBuilder::QueryType type )
    , mIdentificationColumn( QLatin1String( "id" ) )
    , mLimit( -1 )
    , mDistinct( false )
+   , mInsertRowOffset( 0 )
+   , mInsertRowCount( 0 )
+   , mStatementShape( 0 )
 {
 }
 
@@ -182,6 +223,7 @@ void QueryBuilder::sqliteAdaptUpdateJoin( Query::Condition &condition )
 QString QueryBuilder::buildQuery()
 {
   QString statement;
+  mBindValues.clear();
 
   // we add the ON conditions of Inner Joins in a Update query here
   // but don't want to change the mRootCondition on each exec().
@@ -219,10 +261,42 @@ QString QueryBuilder::buildQuery()
     statement += QLatin1String( " (" );
     typedef QPair<QString,QVariant> StringVariantPair;
     QStringList cols, vals;
+    if ( mInsertRowCount > 0 ) {
+      // the current chunk of a batch, as a multi-row INSERT
+      QVector<QVariantList> batchValues;
+      Q_FOREACH ( const StringVariantPair &p, mColumnValues ) {
+        cols.append( p.first );
+        batchValues.append( isBatchValue( p.second ) ? p.second.toList() : QVariantList() );
+      }
+      statement += cols.join( QLatin1String( ", " ) );
+      statement += QLatin1String( ") VALUES " );
+      QStringList rows;
+      for ( int row = mInsertRowOffset; row < mInsertRowOffset + mInsertRowCount; ++row ) {
+        vals.clear();
+        for ( int i = 0; i < mColumnValues.count(); ++i ) {
+          // plain values are the same for all rows
+          vals.append( bindValue( batchValues.at( i ).isEmpty() ? mColumnValues.at( i ).second : batchValues.at( i ).at( row ) ) );
+        }
+        rows.append( QLatin1Char( '(' ) + vals.join( QLatin1String( ", " ) ) + QLatin1Char( ')' ) );
+      }
+      statement += rows.join( QLatin1String( ", " ) );
+      break;
+    }
     Q_FOREACH ( const StringVariantPair &p, mColumnValues ) {
       cols.append( p.first );
       vals.append( bindValue( p.second ) );
     }
+    if ( !mColumns.isEmpty() ) {
+      // INSERT ... SELECT, copying the given columns of all rows matching the WHERE condition
+      cols += mColumns;
+      vals += mColumns;
+      statement += cols.join( QLatin1String( ", " ) );
+      statement += QLatin1String( ") SELECT " );
+      statement += vals.join( QLatin1String( ", " ) );
+      statement += QLatin1String( " FROM " );
+      statement += mTable;
+      break;
+    }
     statement += cols.join( QLatin1String( ", " ) );
     statement += QLatin1String( ") VALUES (" );
     statement += vals.join( QLatin1String( ", " ) );
@@ -335,9 +409,129 @@ void QueryBuilder::setForwardOnly(bool forwardOnly)
     mQuery.setForwardOnly(forwardOnly);
 }
 
+int QueryBuilder::insertBatchSize() const
+{
+  if ( mType != Insert || !mColumns.isEmpty() ) {
+    return -1;
+  }
+  // The SQLite driver we use can't be relied on to support multi-row INSERTs,
+  // keep using batch execution there
+  if ( mDatabaseType != DbType::MySQL && mDatabaseType != DbType::PostgreSQL ) {
+    return -1;
+  }
+  typedef QPair<QString, QVariant> StringVariantPair;
+  Q_FOREACH ( const StringVariantPair &p, mColumnValues ) {
+    if ( isBatchValue( p.second ) ) {
+      return p.second.toList().count();
+    }
+  }
+  return -1;
+}
+
 bool QueryBuilder::exec()
 {
-  const QString statement = buildQuery();
+  // The Qt drivers emulate batch execution by executing the statement once per row.
+  // Insert batches with multi-row INSERTs instead, chunked to stay within the limits
+  // on the number of bound values. Chunks have power of two sizes, so that only a few
+  // different statements end up in the query cache.
+  const int rowCount = insertBatchSize();
+  if ( rowCount <= 0 ) {
+    return execStatement();
+  }
+
+  const int maxRows = qMin( s_maxInsertRows, qMax( 1, s_maxInsertBindValues / qMax( 1, mColumnValues.count() ) ) );
+  bool ret = true;
+  for ( mInsertRowOffset = 0; ret && mInsertRowOffset < rowCount; mInsertRowOffset += mInsertRowCount ) {
+    const int remaining = rowCount - mInsertRowOffset;
+    mInsertRowCount = 1;
+    while ( mInsertRowCount * 2 <= qMin( remaining, maxRows ) ) {
+      mInsertRowCount *= 2;
+    }
+    ret = execStatement();
+  }
+  mInsertRowOffset = 0;
+  mInsertRowCount = 0;
+  return ret;
+}
+
+void QueryBuilder::setStatementShape( const char *shape )
+{
+  mStatementShape = shape;
+}
+
+QString QueryBuilder::reuseOrBuildQuery()
+{
+  // UPDATE queries with joins rewrite their WHERE condition depending on the database,
+  // always build those
+  if ( !mStatementShape || mInsertRowCount > 0 || ( mType == Update && !mJoinedTables.isEmpty() ) ) {
+    return buildQuery();
+  }
+
+  StatementShapeCache *shapes = perThreadStatementShapes();
+  StatementShapeCache::ConstIterator it = shapes->constFind( mStatementShape );
+  if ( it != shapes->constEnd() && it->databaseType == mDatabaseType ) {
+    collectBindValues();
+    // a different number of values means the shape changed after all,
+    // e.g. because of an IN condition with a different number of values
+    if ( mBindValues.count() == it->bindValueCount ) {
+      return it->statement;
+    }
+  }
+
+  StatementShape shape;
+  shape.statement = buildQuery();
+  shape.databaseType = mDatabaseType;
+  shape.bindValueCount = mBindValues.count();
+  shapes->insert( mStatementShape, shape );
+  return shape.statement;
+}
+
+void QueryBuilder::collectBindValues()
+{
+  // this must match the order in which buildQuery() binds the values
+  mBindValues.clear();
+  typedef QPair<QString, QVariant> StringVariantPair;
+
+  switch ( mType ) {
+  case Select:
+    Q_FOREACH ( const QString &joinedTable, mJoinedTables ) {
+      collectBindValues( mJoins.value( joinedTable ).second );
+    }
+    collectBindValues( mRootCondition[WhereCondition] );
+    break;
+  case Insert:
+  case Update:
+    Q_FOREACH ( const StringVariantPair &p, mColumnValues ) {
+      mBindValues << p.second;
+    }
+    collectBindValues( mRootCondition[WhereCondition] );
+    break;
+  case Delete:
+    collectBindValues( mRootCondition[WhereCondition] );
+    break;
+  }
+
+  collectBindValues( mRootCondition[HavingCondition] );
+}
+
+void QueryBuilder::collectBindValues( const Query::Condition &cond )
+{
+  if ( !cond.isEmpty() ) {
+    Q_FOREACH ( const Query::Condition &c, cond.subConditions() ) {
+      collectBindValues( c );
+    }
+  } else if ( cond.mComparedColumn.isEmpty() && cond.mComparedValue.isValid() ) {
+    if ( cond.mComparedValue.canConvert( QVariant::List ) ) {
+      mBindValues << cond.mComparedValue.toList();
+    } else {
+      mBindValues << cond.mComparedValue;
+    }
+  }
+}
+
+bool QueryBuilder::execStatement()
+{
+  const QString statement = reuseOrBuildQuery();
 
 #ifndef QUERYBUILDER_UNITTEST
   if ( QueryCache::contains( statement ) ) {
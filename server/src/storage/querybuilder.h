@@ -110,12 +110,16 @@ class QueryBuilder
 
     /**
       Adds the given columns to a select query.
+      In an INSERT query, the columns are copied from all rows of the table matching
+      the WHERE condition instead (INSERT ... SELECT), together with the values set
+      by setColumnValue(). insertId() is not valid for such queries.
       @param cols The columns you want to select.
     */
     void addColumns( const QStringList &cols );
 
     /**
       Adds the given column to a select query.
+      @see addColumns()
       @param col The column to add.
     */
     void addColumn( const QString &col );
@@ -215,6 +219,20 @@ class QueryBuilder
      */
     void setIdentificationColumn( const QString &column );
 
+    /**
+     * Declares that the SQL statement of this query always has the same shape, only the
+     * bound values differ. The statement is then built only once per thread and reused
+     * by all queries declaring the same @p shape.
+     *
+     * Use this for queries executed often, whose conditions, joins, columns etc. don't
+     * depend on any parameters. A changed number of bound values (e.g. of an IN condition)
+     * is detected, anything else that changes the statement is not.
+     *
+     * @param shape Identifies the shape, compared by address, so this has to be static data,
+     *              usually a string literal naming the query.
+     */
+    void setStatementShape( const char *shape );
+
     /**
       Returns the query, only valid after exec().
     */
@@ -222,6 +240,10 @@ class QueryBuilder
 
     /**
       Executes the query, returns true on success.
+
+      INSERT queries with QVariantList values insert one row per list entry.
+      On MySQL and PostgreSQL, they are executed as chunked multi-row INSERTs,
+      otherwise as batch (see QSqlQuery::execBatch()).
     */
     bool exec();
 
@@ -237,6 +259,17 @@ class QueryBuilder
 
   private:
     QString buildQuery();
+    /** Returns the statement to execute, from the statement shape cache if possible. */
+    QString reuseOrBuildQuery();
+    /** Fills mBindValues like buildQuery() does, without building the statement. */
+    void collectBindValues();
+    void collectBindValues( const Query::Condition &cond );
+    bool execStatement();
+    /**
+     * Returns the number of rows to insert with multi-row INSERTs, or -1 if this
+     * is not a batch INSERT query or multi-row INSERTs are not supported.
+     */
+    int insertBatchSize() const;
     QString bindValue( const QVariant &value );
     QString buildWhereCondition( const Query::Condition &cond );
 
@@ -267,6 +300,10 @@ class QueryBuilder
     QMap< QString, QPair< JoinType, Query::Condition > > mJoins;
     int mLimit;
     bool mDistinct;
+    /// the rows of the batch inserted by the current multi-row INSERT
+    int mInsertRowOffset;
+    int mInsertRowCount;
+    const char *mStatementShape;
 #ifdef QUERYBUILDER_UNITTEST
     QString mStatement;
     friend class ::QueryBuilderTest;
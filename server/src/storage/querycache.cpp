@@ -22,14 +22,22 @@
 #include "datastore.h"
 
 #include <QSqlQuery>
+#include <QThread>
 #include <QThreadStorage>
-#include <QtCore/QHash>
+#include <QtCore/QCache>
+#include <QtCore/QMutex>
+#include <QtCore/QStringList>
 #include <QtCore/QTimer>
 
 using namespace Akonadi::Server;
 
-// After these seconds without activity the cache is cleaned
-#define CLEANUP_TIMEOUT 30 // seconds
+// Maximum number of prepared queries kept per thread, least recently used ones are evicted first
+#define CACHE_SIZE 256 // queries
+
+class Cache;
+
+static QMutex g_cachesLock;
+static QList<Cache *> g_caches;
 
 class Cache : public QObject
 {
@@ -37,26 +45,111 @@ class Cache : public QObject
 public:
 
   Cache()
+    : m_cache( CACHE_SIZE )
+    , m_finishQueries( DbType::type( DataStore::self()->database() ) == DbType::Sqlite )
+  {
+    m_thread = QString::fromLatin1( "0x%1" ).arg( reinterpret_cast<quintptr>( QThread::currentThread() ), 0, 16 );
+    connect( &m_finishTimer, SIGNAL(timeout()), SLOT(finishQueries()) );
+    m_finishTimer.setSingleShot( true );
+
+    QMutexLocker locker( &g_cachesLock );
+    g_caches.append( this );
+  }
+
+  ~Cache()
+  {
+    QMutexLocker locker( &g_cachesLock );
+    g_caches.removeOne( this );
+  }
+
+  bool contains( const QString &queryStatement )
   {
-    connect( &m_cleanupTimer, SIGNAL(timeout()), SLOT(cleanup()));
-    m_cleanupTimer.setSingleShot( true );
+    if ( m_cache.contains( queryStatement ) ) {
+      m_hits.ref();
+      return true;
+    }
+    m_misses.ref();
+    return false;
   }
 
   QSqlQuery query( const QString &queryStatement )
   {
-    m_cleanupTimer.start( CLEANUP_TIMEOUT * 1000 );
-    return m_cache.value( queryStatement );
+    // object() also marks the query as most recently used
+    QSqlQuery *query = m_cache.object( queryStatement );
+    if ( !query ) {
+      return QSqlQuery();
+    }
+    queryUsed( *query );
+    return *query;
+  }
+
+  void insert( const QString &queryStatement, const QSqlQuery &query )
+  {
+    const int size = m_cache.size();
+    const bool replaced = m_cache.contains( queryStatement );
+    m_cache.insert( queryStatement, new QSqlQuery( query ) );
+    if ( !replaced ) {
+      m_evictions.fetchAndAddRelaxed( size + 1 - m_cache.size() );
+    }
+    m_size.fetchAndStoreRelaxed( m_cache.size() );
+    queryUsed( query );
+  }
+
+  QString statistics() const
+  {
+    return QString::fromLatin1( "thread %1: %2/%3 queries, %4 hits, %5 misses, %6 evictions" )
+        .arg( m_thread )
+        .arg( const_cast<QAtomicInt &>( m_size ).fetchAndAddOrdered( 0 ) )
+        .arg( CACHE_SIZE )
+        .arg( const_cast<QAtomicInt &>( m_hits ).fetchAndAddOrdered( 0 ) )
+        .arg( const_cast<QAtomicInt &>( m_misses ).fetchAndAddOrdered( 0 ) )
+        .arg( const_cast<QAtomicInt &>( m_evictions ).fetchAndAddOrdered( 0 ) );
   }
 
 public Q_SLOTS:
   void cleanup()
   {
+    m_usedQueries.clear();
     m_cache.clear();
+    m_size.fetchAndStoreRelaxed( 0 );
+  }
+
+  /**
+   * With SQLite an active statement holds a read lock on the tables it reads from,
+   * which blocks writers in other threads. Uncached queries release it when they
+   * are destroyed, so do the same for the cached ones once the current command
+   * has been processed and we are back in the event loop.
+   */
+  void finishQueries()
+  {
+    m_finishTimer.stop();
+    for ( QList<QSqlQuery>::Iterator it = m_usedQueries.begin(); it != m_usedQueries.end(); ++it ) {
+      it->finish();
+    }
+    m_usedQueries.clear();
   }
 
-public: // public, this is just a helper class
-  QHash<QString, QSqlQuery> m_cache;
-  QTimer m_cleanupTimer;
+private:
+  void queryUsed( const QSqlQuery &query )
+  {
+    if ( !m_finishQueries ) {
+      return;
+    }
+    m_usedQueries << query;
+    if ( !m_finishTimer.isActive() ) {
+      m_finishTimer.start( 0 );
+    }
+  }
+
+  QCache<QString, QSqlQuery> m_cache;
+  QList<QSqlQuery> m_usedQueries;
+  QTimer m_finishTimer;
+  bool m_finishQueries;
+  QString m_thread;
+  QAtomicInt m_size;
+  QAtomicInt m_hits;
+  QAtomicInt m_misses;
+  QAtomicInt m_evictions;
 };
 
 static QThreadStorage<Cache *> g_queryCache;
@@ -72,11 +165,7 @@ static Cache *perThreadCache()
 
 bool QueryCache::contains( const QString &queryStatement )
 {
-  if ( DbType::type( DataStore::self()->database() ) == DbType::Sqlite ) {
-    return false;
-  } else {
-    return perThreadCache()->m_cache.contains( queryStatement );
-  }
+  return perThreadCache()->contains( queryStatement );
 }
 
 QSqlQuery QueryCache::query( const QString &queryStatement )
@@ -86,9 +175,7 @@ QSqlQuery QueryCache::query( const QString &queryStatement )
 
 void QueryCache::insert( const QString &queryStatement, const QSqlQuery &query )
 {
-  if ( DbType::type( DataStore::self()->database() ) != DbType::Sqlite ) {
-    perThreadCache()->m_cache.insert( queryStatement, query );
-  }
+  perThreadCache()->insert( queryStatement, query );
 }
 
 void QueryCache::clear()
@@ -100,5 +187,24 @@ void QueryCache::clear()
   g_queryCache.localData()->cleanup();
 }
 
+void QueryCache::finishQueries()
+{
+  if ( !g_queryCache.hasLocalData() ) {
+    return;
+  }
+
+  g_queryCache.localData()->finishQueries();
+}
+
+QStringList QueryCache::statistics()
+{
+  QStringList statistics;
+  QMutexLocker locker( &g_cachesLock );
+  Q_FOREACH ( const Cache *cache, g_caches ) {
+    statistics << cache->statistics();
+  }
+  return statistics;
+}
+
 
 #include <querycache.moc>
@@ -21,6 +21,7 @@
 #define AKONADI_QUERYCACHE_H
 
 class QString;
+class QStringList;
 class QSqlQuery;
 
 namespace Akonadi {
@@ -29,6 +30,10 @@ namespace Server {
 /**
  * A per-thread cache (should be per session, but that'S the same for us) prepared
  * query cache.
+ *
+ * The cache is keyed by the SQL statement, with all values bound rather than
+ * inlined, and holds at most a fixed number of queries. When it is full, the least
+ * recently used query is evicted.
  */
 namespace QueryCache
 {
@@ -44,6 +49,20 @@ namespace QueryCache
   /// Clears all queries from current thread
   void clear();
 
+  /**
+   * Finishes all queries of the current thread used since the last call, so that
+   * they release the locks they hold (SQLite only, no-op otherwise).
+   *
+   * This happens automatically once the thread is back in its event loop. Call it
+   * before blocking the thread in any other way, e.g. while waiting for a resource,
+   * since other threads might not be able to write to the database meanwhile. The
+   * results of the finished queries must not be used anymore.
+   */
+  void finishQueries();
+
+  /// Returns size, hit, miss and eviction counts of the caches of all threads, one entry per thread
+  QStringList statistics();
+
 } // namespace QueryCache
 
 } // namespace Server
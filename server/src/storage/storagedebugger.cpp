@@ -76,6 +76,11 @@ void StorageDebugger::writeToFile( const QString &file )
     mFile->open(QIODevice::WriteOnly);
 }
 
+qint64 StorageDebugger::executedQueriesCount()
+{
+  return mSequence.fetchAndAddOrdered( 0 );
+}
+
 void StorageDebugger::queryExecuted( const QSqlQuery &query, int duration )
 {
   const qint64 seq = mSequence.fetchAndAddOrdered(1);
@@ -54,6 +54,12 @@ class StorageDebugger : public QObject
 
     void incSequence() { mSequence.ref(); }
 
+    /**
+     * Returns the number of queries executed so far, regardless of whether
+     * SQL debugging is enabled or not.
+     */
+    qint64 executedQueriesCount();
+
     void writeToFile( const QString &file );
 
   Q_SIGNALS:
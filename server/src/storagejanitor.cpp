@@ -25,6 +25,7 @@
 #include "storage/selectquerybuilder.h"
 #include "storage/parthelper.h"
 #include "storage/dbconfig.h"
+#include "storage/collectionstatistics.h"
 #include "resourcemanager.h"
 #include "entities.h"
 #include "dbusconnectionpool.h"
@@ -117,6 +118,9 @@ void StorageJanitor::check() // implementation of `akonadictl fsck`
   inform( "Looking for dirty objects..." );
   findDirtyObjects();
 
+  inform( "Recalculating collection statistics..." );
+  checkCollectionStatistics();
+
   /* TODO some ideas for further checks:
    * the collection tree is non-cyclic
    * content type constraints of collections are not violated
@@ -562,6 +566,16 @@ void StorageJanitor::checkSizeTreshold()
   }
 }
 
+void StorageJanitor::checkCollectionStatistics()
+{
+  const int wrong = CollectionStatistics::self()->recalculateAll();
+  if ( wrong < 0 ) {
+    inform( "Failed to recalculate collection statistics." );
+  } else {
+    inform( QLatin1Literal( "Found " ) + QString::number( wrong ) + QLatin1Literal( " collections with outdated statistics." ) );
+  }
+}
+
 void StorageJanitor::inform( const char *msg )
 {
   inform( QLatin1String( msg ) );
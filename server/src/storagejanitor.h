@@ -119,6 +119,11 @@ class StorageJanitor : public QObject
      */
     void checkSizeTreshold();
 
+    /**
+     * Recalculate the cached statistics of all collections.
+     */
+    void checkCollectionStatistics();
+
   private:
     QDBusConnection m_connection;
     qint64 m_lostFoundCollectionId;
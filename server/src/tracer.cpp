@@ -26,6 +26,7 @@
 #include "dbustracer.h"
 #include "filetracer.h"
 #include "nulltracer.h"
+#include "ringbuffertracer.h"
 #include <libs/xdgbasedirs_p.h>
 #include <akstandarddirs.h>
 
@@ -38,6 +39,7 @@ Tracer *Tracer::mSelf = 0;
 
 Tracer::Tracer()
   : mTracerBackend( 0 )
+  , mEnabled( 0 )
 {
   activateTracer( currentTracer() );
 
@@ -63,6 +65,10 @@ Tracer *Tracer::self()
 
 void Tracer::beginConnection( const QString &identifier, const QString &msg )
 {
+  if ( !isEnabled() ) {
+    return;
+  }
+
   mMutex.lock();
   mTracerBackend->beginConnection( identifier, msg );
   mMutex.unlock();
@@ -70,6 +76,10 @@ void Tracer::beginConnection( const QString &identifier, const QString &msg )
 
 void Tracer::endConnection( const QString &identifier, const QString &msg )
 {
+  if ( !isEnabled() ) {
+    return;
+  }
+
   mMutex.lock();
   mTracerBackend->endConnection( identifier, msg );
   mMutex.unlock();
@@ -77,6 +87,10 @@ void Tracer::endConnection( const QString &identifier, const QString &msg )
 
 void Tracer::connectionInput( const QString &identifier, const QByteArray &msg )
 {
+  if ( !isEnabled() ) {
+    return;
+  }
+
   mMutex.lock();
   mTracerBackend->connectionInput( identifier, msg );
   mMutex.unlock();
@@ -84,6 +98,10 @@ void Tracer::connectionInput( const QString &identifier, const QByteArray &msg )
 
 void Tracer::connectionOutput( const QString &identifier, const QByteArray &msg )
 {
+  if ( !isEnabled() ) {
+    return;
+  }
+
   mMutex.lock();
   mTracerBackend->connectionOutput( identifier, msg );
   mMutex.unlock();
@@ -91,6 +109,10 @@ void Tracer::connectionOutput( const QString &identifier, const QByteArray &msg
 
 void Tracer::signal( const QString &signalName, const QString &msg )
 {
+  if ( !isEnabled() ) {
+    return;
+  }
+
   mMutex.lock();
   mTracerBackend->signal( signalName, msg );
   mMutex.unlock();
@@ -103,6 +125,10 @@ void Tracer::signal( const char *signalName, const QString &msg )
 
 void Tracer::warning( const QString &componentName, const QString &msg )
 {
+  if ( !isEnabled() ) {
+    return;
+  }
+
   mMutex.lock();
   mTracerBackend->warning( componentName, msg );
   mMutex.unlock();
@@ -110,6 +136,10 @@ void Tracer::warning( const QString &componentName, const QString &msg )
 
 void Tracer::error( const QString &componentName, const QString &msg )
 {
+  if ( !isEnabled() ) {
+    return;
+  }
+
   mMutex.lock();
   mTracerBackend->error( componentName, msg );
   mMutex.unlock();
@@ -120,6 +150,17 @@ void Tracer::error( const char *componentName, const QString &msg )
   error( QLatin1String( componentName ), msg );
 }
 
+void Tracer::dump()
+{
+  if ( !isEnabled() ) {
+    return;
+  }
+
+  mMutex.lock();
+  mTracerBackend->dump();
+  mMutex.unlock();
+}
+
 QString Tracer::currentTracer() const
 {
   QMutexLocker locker( &mMutex );
@@ -130,6 +171,7 @@ QString Tracer::currentTracer() const
 void Tracer::activateTracer( const QString &type )
 {
   QMutexLocker locker( &mMutex );
+  mEnabled = 0;
   delete mTracerBackend;
   mTracerBackend = 0;
 
@@ -141,10 +183,16 @@ void Tracer::activateTracer( const QString &type )
     const QSettings settings( AkStandardDirs::serverConfigFile(), QSettings::IniFormat );
     const QString file = settings.value( QLatin1String( "Debug/File" ), QLatin1String( "/dev/null" ) ).toString();
     mTracerBackend = new FileTracer( file );
+  } else if ( type == QLatin1String( "ringbuffer" ) ) {
+    const QSettings settings( AkStandardDirs::serverConfigFile(), QSettings::IniFormat );
+    const QString file = settings.value( QLatin1String( "Debug/File" ), QLatin1String( "/dev/null" ) ).toString();
+    const int size = settings.value( QLatin1String( "Debug/RingBufferSize" ), 4 * 1024 * 1024 ).toInt();
+    mTracerBackend = new RingBufferTracer( file, size );
   } else if ( type == QLatin1String( "null" ) ) {
     mTracerBackend = new NullTracer();
   } else {
     mTracerBackend = new DBusTracer();
   }
   Q_ASSERT( mTracerBackend );
+  mEnabled = mTracerBackend->isEnabled() ? 1 : 0;
 }
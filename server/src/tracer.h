@@ -22,6 +22,11 @@
 
 #include <QtCore/QObject>
 #include <QtCore/QMutex>
+#ifdef QT5_BUILD
+#include <QAtomicInt>
+#else
+#include <QtCore/QAtomicInt>
+#endif
 
 #include "tracerinterface.h"
 
@@ -49,6 +54,22 @@ class Tracer : public QObject, public TracerInterface
      */
     virtual ~Tracer();
 
+    /**
+     * Returns whether the active tracer processes tracing information at all.
+     *
+     * This does not lock, callers should check it before building expensive
+     * tracing messages. All tracing methods return immediately when the
+     * tracer is disabled.
+     */
+    bool isEnabled() const
+    {
+#ifdef QT5_BUILD
+      return mEnabled.loadAcquire();
+#else
+      return mEnabled;
+#endif
+    }
+
   public Q_SLOTS:
     /**
      * This method is called whenever a new data (imap) connection to the akonadi server
@@ -127,12 +148,20 @@ class Tracer : public QObject, public TracerInterface
      */
     void activateTracer( const QString &type );
 
+    /**
+     * Writes out tracing information the active tracer keeps in memory,
+     * e.g. the content of the ring buffer. Called on server shutdown, since
+     * the tracer itself is never destroyed.
+     */
+    void dump();
+
   private:
     Tracer();
 
     static Tracer *mSelf;
 
     TracerInterface *mTracerBackend;
+    QAtomicInt mEnabled;
     mutable QMutex mMutex;
 };
 
@@ -40,6 +40,19 @@ class TracerInterface
   public:
     virtual ~TracerInterface() {}
 
+    /**
+     * Returns whether this tracer processes the tracing information at all.
+     * If not, the tracing methods are not called and callers can skip
+     * building the messages.
+     */
+    virtual bool isEnabled() const { return true; }
+
+    /**
+     * Writes out tracing information the tracer keeps in memory.
+     * Tracers writing everything immediately don't need to reimplement this.
+     */
+    virtual void dump() {}
+
     /**
      * This method is called whenever a new data (imap) connection to the akonadi server
      * is established.
@@ -0,0 +1,138 @@
+/*
+    Copyright (c) 2014 Akonadi developers
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+#include <QObject>
+
+#include <storage/datastore.h>
+#include <storage/querybuilder.h>
+#include <storage/transaction.h>
+
+#include "fakeakonadiserver.h"
+#include "aktest.h"
+#include "akdebug.h"
+#include "entities.h"
+
+#include <QtTest/QTest>
+
+using namespace Akonadi;
+using namespace Akonadi::Server;
+
+static bool insertFlags(DbType::Type dbType, int count, int offset = 0)
+{
+    QVariantList names;
+    for (int i = offset; i < offset + count; ++i) {
+        names << QString::fromLatin1("\\BATCH%1").arg(i);
+    }
+
+    QueryBuilder qb(Flag::tableName(), QueryBuilder::Insert);
+    qb.setDatabaseType(dbType);
+    qb.setColumnValue(Flag::nameColumn(), names);
+    qb.setIdentificationColumn(QString());
+    return qb.exec();
+}
+
+static int flagCount()
+{
+    QueryBuilder qb(Flag::tableName(), QueryBuilder::Select);
+    qb.addAggregation(Flag::idColumn(), QLatin1String("count"));
+    qb.addValueCondition(Flag::nameColumn(), Query::Like, QLatin1String("\\BATCH%"));
+    if (!qb.exec() || !qb.query().next()) {
+        return -1;
+    }
+    const int count = qb.query().value(0).toInt();
+    qb.query().finish();
+    return count;
+}
+
+class BatchInsertTest : public QObject
+{
+    Q_OBJECT
+
+public:
+    BatchInsertTest()
+        : QObject()
+    {
+        try {
+            FakeAkonadiServer::instance()->setPopulateDb(false);
+            FakeAkonadiServer::instance()->init();
+        } catch (const FakeAkonadiServerException &e) {
+            akError() << "Server exception: " << e.what();
+            akFatal() << "Fake Akonadi Server failed to start up, aborting test";
+        }
+    }
+
+    ~BatchInsertTest()
+    {
+        FakeAkonadiServer::instance()->quit();
+    }
+
+private Q_SLOTS:
+    void testInsert_data()
+    {
+        QTest::addColumn<int>("dbType");
+        QTest::addColumn<int>("count");
+
+        // SQLite understands multi-row INSERTs as well, so the MySQL code path
+        // can be verified against the test database, as long as no statement
+        // binds more than the 999 values SQLite allows. The chunking of larger
+        // batches is checked in querybuildertest.
+        QTest::newRow("batch") << static_cast<int>(DbType::Sqlite) << 1500;
+        QTest::newRow("multi-row single") << static_cast<int>(DbType::MySQL) << 1;
+        QTest::newRow("multi-row chunked") << static_cast<int>(DbType::MySQL) << 999;
+    }
+
+    void testInsert()
+    {
+        QFETCH(int, dbType);
+        QFETCH(int, count);
+
+        Transaction transaction(DataStore::self());
+        QVERIFY(insertFlags(static_cast<DbType::Type>(dbType), count));
+        QCOMPARE(flagCount(), count);
+        // the transaction is rolled back
+    }
+
+//No point in running the benchmark everytime
+#if 0
+    void benchmarkInsert_data()
+    {
+        QTest::addColumn<int>("dbType");
+
+        QTest::newRow("batch") << static_cast<int>(DbType::Sqlite);
+        QTest::newRow("multi-row") << static_cast<int>(DbType::MySQL);
+    }
+
+    void benchmarkInsert()
+    {
+        QFETCH(int, dbType);
+
+        QBENCHMARK {
+            Transaction transaction(DataStore::self());
+            // batches of 999 rows, to stay within SQLite's limit of bound values
+            for (int i = 0; i < 20; ++i) {
+                QVERIFY(insertFlags(static_cast<DbType::Type>(dbType), 999, i * 999));
+            }
+        }
+    }
+#endif
+};
+
+AKTEST_FAKESERVER_MAIN(BatchInsertTest)
+
+#include "batchinserttest.moc"
@@ -0,0 +1,196 @@
+/*
+    Copyright (c) 2014 Akonadi developers
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+#include <QObject>
+
+#include <intervalcheck.h>
+#include <cachecleaner.h>
+
+#include "fakeakonadiserver.h"
+#include "aktest.h"
+#include "akdebug.h"
+#include "entities.h"
+
+#include <QtTest/QTest>
+
+using namespace Akonadi;
+using namespace Akonadi::Server;
+
+template <typename Scheduler>
+class TestScheduler : public Scheduler
+{
+public:
+    using Scheduler::scheduleCollection;
+
+    int scheduledCount() const
+    {
+        return Scheduler::mScheduledCollections.count();
+    }
+
+    int timestampCount() const
+    {
+        return Scheduler::mSchedule.count();
+    }
+
+    int interval(qint64 collectionId) const
+    {
+        return Scheduler::mScheduledCollections.value(collectionId).interval;
+    }
+};
+
+static Collection intervalCheckCollection(qint64 id, int interval)
+{
+    Collection col;
+    col.setId(id);
+    col.setParentId(0);
+    col.setEnabled(true);
+    col.setSyncPref(Tristate::Undefined);
+    col.setCachePolicyInherit(false);
+    col.setCachePolicyCheckInterval(interval);
+    return col;
+}
+
+static Collection cacheCleanerCollection(qint64 id, int timeout)
+{
+    Collection col;
+    col.setId(id);
+    col.setParentId(0);
+    col.setResourceId(1);
+    col.setEnabled(true);
+    col.setCachePolicyInherit(false);
+    col.setCachePolicyCacheTimeout(timeout);
+    col.setCachePolicyLocalParts(QLatin1String("ENV"));
+    return col;
+}
+
+class CollectionSchedulerTest : public QObject
+{
+    Q_OBJECT
+
+public:
+    CollectionSchedulerTest()
+        : QObject()
+    {
+        try {
+            FakeAkonadiServer::instance()->setPopulateDb(false);
+            FakeAkonadiServer::instance()->init();
+        } catch (const FakeAkonadiServerException &e) {
+            akError() << "Server exception: " << e.what();
+            akFatal() << "Fake Akonadi Server failed to start up, aborting test";
+        }
+    }
+
+    ~CollectionSchedulerTest()
+    {
+        FakeAkonadiServer::instance()->quit();
+    }
+
+private Q_SLOTS:
+    void testSchedule()
+    {
+        TestScheduler<IntervalCheck> scheduler;
+
+        scheduler.scheduleCollection(intervalCheckCollection(1, 5));
+        scheduler.scheduleCollection(intervalCheckCollection(2, 5));
+        scheduler.scheduleCollection(intervalCheckCollection(3, 30));
+        QCOMPARE(scheduler.scheduledCount(), 3);
+        // checks within a minute are grouped
+        QCOMPARE(scheduler.timestampCount(), 2);
+
+        // rescheduling replaces the old entry
+        scheduler.scheduleCollection(intervalCheckCollection(1, 30));
+        QCOMPARE(scheduler.scheduledCount(), 3);
+        QCOMPARE(scheduler.timestampCount(), 2);
+        QCOMPARE(scheduler.interval(1), 30);
+
+        // intervals below the minimum are raised to it
+        scheduler.scheduleCollection(intervalCheckCollection(4, 1));
+        QCOMPARE(scheduler.interval(4), 5);
+
+        // collections that should not be scheduled anymore are removed
+        scheduler.scheduleCollection(intervalCheckCollection(4, 0));
+        QCOMPARE(scheduler.scheduledCount(), 3);
+
+        scheduler.collectionRemoved(2);
+        QCOMPARE(scheduler.scheduledCount(), 2);
+        QCOMPARE(scheduler.timestampCount(), 1);
+
+        // removing an unknown collection is a no-op
+        scheduler.collectionRemoved(2);
+        QCOMPARE(scheduler.scheduledCount(), 2);
+
+        scheduler.collectionRemoved(1);
+        scheduler.collectionRemoved(3);
+        QCOMPARE(scheduler.scheduledCount(), 0);
+        QCOMPARE(scheduler.timestampCount(), 0);
+    }
+
+    void testCacheCleanerSchedule()
+    {
+        TestScheduler<CacheCleaner> scheduler;
+
+        scheduler.scheduleCollection(cacheCleanerCollection(1, 10));
+        Collection col = cacheCleanerCollection(2, 10);
+        col.setCachePolicyLocalParts(QLatin1String("ALL"));
+        scheduler.scheduleCollection(col);
+        QCOMPARE(scheduler.scheduledCount(), 1);
+
+        scheduler.collectionRemoved(1);
+        QCOMPARE(scheduler.scheduledCount(), 0);
+    }
+
+//No point in running the benchmark everytime
+#if 0
+    void benchmarkIntervalCheck()
+    {
+        QBENCHMARK {
+            TestScheduler<IntervalCheck> scheduler;
+            for (int i = 1; i <= 100000; ++i) {
+                scheduler.scheduleCollection(intervalCheckCollection(i, 5 + i % 120));
+            }
+            for (int i = 1; i <= 100000; ++i) {
+                scheduler.scheduleCollection(intervalCheckCollection(i, 5 + (i + 60) % 120));
+            }
+            for (int i = 1; i <= 100000; ++i) {
+                scheduler.collectionRemoved(i);
+            }
+        }
+    }
+
+    void benchmarkCacheCleaner()
+    {
+        QBENCHMARK {
+            TestScheduler<CacheCleaner> scheduler;
+            for (int i = 1; i <= 100000; ++i) {
+                scheduler.scheduleCollection(cacheCleanerCollection(i, 5 + i % 120));
+            }
+            for (int i = 1; i <= 100000; ++i) {
+                scheduler.scheduleCollection(cacheCleanerCollection(i, 5 + (i + 60) % 120));
+            }
+            for (int i = 1; i <= 100000; ++i) {
+                scheduler.collectionRemoved(i);
+            }
+        }
+    }
+#endif
+};
+
+AKTEST_FAKESERVER_MAIN(CollectionSchedulerTest)
+
+#include "collectionschedulertest.moc"
@@ -0,0 +1,168 @@
+/*
+    Copyright (c) 2014 Akonadi developers
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+#include <QObject>
+
+#include <storage/collectionstatistics.h>
+#include <storage/datastore.h>
+#include <storage/notificationcollector.h>
+#include <storage/transaction.h>
+
+#include "fakeakonadiserver.h"
+#include "aktest.h"
+#include "akdebug.h"
+#include "entities.h"
+#include "dbinitializer.h"
+
+#include <QtTest/QTest>
+
+using namespace Akonadi;
+using namespace Akonadi::Server;
+
+static qint64 itemCount(const Collection &col)
+{
+    CollectionStatistics::Statistics statistics;
+    if (!CollectionStatistics::self()->statistics(col, statistics)) {
+        return -1;
+    }
+    return statistics.count;
+}
+
+class CollectionStatisticsTest : public QObject
+{
+    Q_OBJECT
+
+    DbInitializer initializer;
+
+public:
+    CollectionStatisticsTest()
+    {
+        try {
+            FakeAkonadiServer::instance()->setPopulateDb(false);
+            FakeAkonadiServer::instance()->init();
+        } catch (const FakeAkonadiServerException &e) {
+            akError() << "Server exception: " << e.what();
+            akFatal() << "Fake Akonadi Server failed to start up, aborting test";
+        }
+
+        initializer.createResource("testresource");
+    }
+
+    ~CollectionStatisticsTest()
+    {
+        FakeAkonadiServer::instance()->quit();
+    }
+
+private:
+    Collection createCollection(const char *name, int items)
+    {
+        const Collection col = initializer.createCollection(name);
+        for (int i = 0; i < items; ++i) {
+            initializer.createItem(QByteArray(name + QByteArray::number(i)).constData(), col);
+        }
+        return col;
+    }
+
+private Q_SLOTS:
+    void testCommit()
+    {
+        const Collection col = createCollection("commit", 2);
+        QCOMPARE(itemCount(col), 2ll);
+
+        // committed deltas are applied to the cached statistics, without
+        // looking at the database again
+        {
+            Transaction transaction(DataStore::self());
+            DataStore::self()->notificationCollector()->collectionStatisticsChanged(col.id(), 3, 0, 0);
+            QVERIFY(transaction.commit());
+        }
+        QCOMPARE(itemCount(col), 5ll);
+    }
+
+    void testRollback()
+    {
+        const Collection col = createCollection("rollback", 2);
+        QCOMPARE(itemCount(col), 2ll);
+
+        // statistics are not cached while a transaction changes them
+        {
+            Transaction transaction(DataStore::self());
+            DataStore::self()->notificationCollector()->collectionStatisticsChanged(col.id(), 1, 0, 0);
+            initializer.createItem("rollback2", col);
+            QCOMPARE(itemCount(col), 3ll);
+            // rolled back
+        }
+
+        // the delta is dropped, the statistics are calculated again
+        QCOMPARE(itemCount(col), 2ll);
+    }
+
+    void testInvalidation()
+    {
+        const Collection col = createCollection("invalidation", 2);
+        QCOMPARE(itemCount(col), 2ll);
+
+        // make the cached statistics differ from the database content
+        CollectionStatistics::self()->beginChange(col.id());
+        CollectionStatistics::Statistics delta;
+        delta.count = 10;
+        CollectionStatistics::self()->commitChange(col.id(), delta);
+        QCOMPARE(itemCount(col), 12ll);
+
+        DataStore::self()->notificationCollector()->collectionRemoved(col);
+        QCOMPARE(itemCount(col), 2ll);
+
+        // moving items invalidates both the source and the destination
+        const Collection dest = createCollection("invalidationdest", 1);
+        QCOMPARE(itemCount(dest), 1ll);
+        CollectionStatistics::self()->beginChange(col.id());
+        CollectionStatistics::self()->commitChange(col.id(), delta);
+        CollectionStatistics::self()->beginChange(dest.id());
+        CollectionStatistics::self()->commitChange(dest.id(), delta);
+        QCOMPARE(itemCount(col), 12ll);
+        QCOMPARE(itemCount(dest), 11ll);
+
+        DataStore::self()->notificationCollector()->itemsMoved(PimItem::List(), col, dest);
+        QCOMPARE(itemCount(col), 2ll);
+        QCOMPARE(itemCount(dest), 1ll);
+    }
+
+    void testRecalculateAll()
+    {
+        const Collection col = createCollection("recalculate", 2);
+        QCOMPARE(itemCount(col), 2ll);
+        // bring the cache of all collections up to date first
+        QVERIFY(CollectionStatistics::self()->recalculateAll() >= 0);
+        QCOMPARE(CollectionStatistics::self()->recalculateAll(), 0);
+
+        CollectionStatistics::self()->beginChange(col.id());
+        CollectionStatistics::Statistics delta;
+        delta.count = 1;
+        CollectionStatistics::self()->commitChange(col.id(), delta);
+        QCOMPARE(itemCount(col), 3ll);
+
+        QCOMPARE(CollectionStatistics::self()->recalculateAll(), 1);
+        QCOMPARE(itemCount(col), 2ll);
+        QCOMPARE(CollectionStatistics::self()->recalculateAll(), 0);
+    }
+};
+
+AKTEST_FAKESERVER_MAIN(CollectionStatisticsTest)
+
+#include "collectionstatisticstest.moc"
@@ -0,0 +1,231 @@
+/*
+    Copyright (c) 2014 Akonadi developers
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+#include <QObject>
+
+#include <storage/parthelper.h>
+#include <storage/parttypehelper.h>
+#include <storage/selectquerybuilder.h>
+#include <response.h>
+
+#include "fakeakonadiserver.h"
+#include "aktest.h"
+#include "akdebug.h"
+#include "entities.h"
+#include "dbinitializer.h"
+
+#include <QtTest/QTest>
+#include <QFile>
+
+using namespace Akonadi;
+using namespace Akonadi::Server;
+
+static bool writeFile(const QString &fileName, const QByteArray &data)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        return false;
+    }
+    return file.write(data) == data.size();
+}
+
+static QByteArray readFile(const QString &fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return QByteArray();
+    }
+    return file.readAll();
+}
+
+class CopyHandlerTest : public QObject
+{
+    Q_OBJECT
+
+    DbInitializer initializer;
+
+public:
+    CopyHandlerTest()
+    {
+        qRegisterMetaType<Akonadi::Server::Response>();
+
+        try {
+            FakeAkonadiServer::instance()->setPopulateDb(false);
+            FakeAkonadiServer::instance()->init();
+        } catch (const FakeAkonadiServerException &e) {
+            akError() << "Server exception: " << e.what();
+            akFatal() << "Fake Akonadi Server failed to start up, aborting test";
+        }
+
+        initializer.createResource("testresource");
+    }
+
+    ~CopyHandlerTest()
+    {
+        FakeAkonadiServer::instance()->quit();
+    }
+
+private:
+    Part createPart(const PimItem &item, const char *type, const QByteArray &data, bool external)
+    {
+        Part part;
+        part.setPimItemId(item.id());
+        part.setPartType(PartTypeHelper::fromFqName(QByteArray(type)));
+        part.setData(external ? QByteArray() : data);
+        part.setDatasize(data.size());
+        part.setExternal(external);
+        if (!part.insert()) {
+            return Part();
+        }
+        if (external) {
+            const QString fileName = PartHelper::fileNameForPart(&part) + QLatin1String("_r0");
+            part.setData(fileName.toLocal8Bit());
+            if (!writeFile(PartHelper::storagePath() + fileName, data) || !part.update()) {
+                return Part();
+            }
+        }
+        return part;
+    }
+
+    void copy(const PimItem &item, const Collection &target)
+    {
+        QList<QByteArray> scenario;
+        scenario << FakeAkonadiServer::defaultScenario()
+                 << "C: 2 COPY " + QByteArray::number(item.id()) + " " + QByteArray::number(target.id())
+                 << "S: 2 OK COPY complete";
+        FakeAkonadiServer::instance()->setScenario(scenario);
+        FakeAkonadiServer::instance()->runTest();
+    }
+
+    PimItem copiedItem(const Collection &target)
+    {
+        SelectQueryBuilder<PimItem> qb;
+        qb.addValueCondition(PimItem::collectionIdColumn(), Query::Equals, target.id());
+        if (!qb.exec() || qb.result().count() != 1) {
+            return PimItem();
+        }
+        return qb.result().first();
+    }
+
+    Part partOfType(const PimItem &item, const char *type)
+    {
+        const PartType partType = PartTypeHelper::fromFqName(QByteArray(type));
+        Q_FOREACH (const Part &part, item.parts()) {
+            if (part.partTypeId() == partType.id()) {
+                return part;
+            }
+        }
+        return Part();
+    }
+
+private Q_SLOTS:
+    void testCloneFile()
+    {
+        const QString source = PartHelper::storagePath() + QLatin1String("clonefiletest_source");
+        const QString target = PartHelper::storagePath() + QLatin1String("clonefiletest_target");
+        QFile::remove(source);
+        QFile::remove(target);
+        QVERIFY(writeFile(source, "payload"));
+
+        // whichever of reflink, hardlink and copy worked, the content is the same
+        QVERIFY(PartHelper::cloneFile(source, target));
+        QCOMPARE(readFile(target), QByteArray("payload"));
+
+        // the clone survives removing the source, like removing the payload file of the original part
+        QVERIFY(QFile::remove(source));
+        QCOMPARE(readFile(target), QByteArray("payload"));
+
+        // all strategies refuse to overwrite an existing file
+        QVERIFY(writeFile(source, "other payload"));
+        QVERIFY(!PartHelper::cloneFile(source, target));
+        QCOMPARE(readFile(target), QByteArray("payload"));
+
+        // a missing source fails all of them
+        QVERIFY(QFile::remove(source));
+        QVERIFY(QFile::remove(target));
+        QVERIFY(!PartHelper::cloneFile(source, target));
+        QVERIFY(!QFile::exists(target));
+    }
+
+    void testCopyParts()
+    {
+        const Collection source = initializer.createCollection("copySource");
+        const Collection target = initializer.createCollection("copyTarget");
+        const PimItem item = initializer.createItem("item", source);
+        const Part internalPart = createPart(item, "PLD:RFC822", "internal payload", false);
+        const Part externalPart = createPart(item, "PLD:ATTACHMENT", "external payload", true);
+        QVERIFY(internalPart.isValid());
+        QVERIFY(externalPart.isValid());
+
+        copy(item, target);
+
+        const PimItem newItem = copiedItem(target);
+        QVERIFY(newItem.isValid());
+        QCOMPARE(newItem.parts().count(), 2);
+
+        // internal parts are copied by INSERT ... SELECT
+        const Part newInternalPart = partOfType(newItem, "PLD:RFC822");
+        QVERIFY(newInternalPart.isValid());
+        QVERIFY(newInternalPart.id() != internalPart.id());
+        QVERIFY(!newInternalPart.external());
+        QCOMPARE(newInternalPart.data(), QByteArray("internal payload"));
+        QCOMPARE(newInternalPart.datasize(), internalPart.datasize());
+
+        // external parts get their own payload file
+        const Part newExternalPart = partOfType(newItem, "PLD:ATTACHMENT");
+        QVERIFY(newExternalPart.isValid());
+        QVERIFY(newExternalPart.external());
+        QVERIFY(newExternalPart.data() != externalPart.data());
+        QCOMPARE(newExternalPart.datasize(), externalPart.datasize());
+        QCOMPARE(PartHelper::translateData(newExternalPart), QByteArray("external payload"));
+
+        // which stays valid when the original is removed
+        QVERIFY(QFile::remove(PartHelper::resolveAbsolutePath(externalPart.data())));
+        QCOMPARE(PartHelper::translateData(newExternalPart), QByteArray("external payload"));
+    }
+
+    void testCopyMissingPayloadFile()
+    {
+        const Collection source = initializer.createCollection("missingSource");
+        const Collection target = initializer.createCollection("missingTarget");
+        const PimItem item = initializer.createItem("missing", source);
+        QVERIFY(createPart(item, "PLD:RFC822", "internal payload", false).isValid());
+        const Part externalPart = createPart(item, "PLD:ATTACHMENT", "external payload", true);
+        QVERIFY(externalPart.isValid());
+        QVERIFY(QFile::remove(PartHelper::resolveAbsolutePath(externalPart.data())));
+
+        // the copy still succeeds, the part without payload file is copied as an empty part
+        copy(item, target);
+
+        const PimItem newItem = copiedItem(target);
+        QVERIFY(newItem.isValid());
+        QCOMPARE(newItem.parts().count(), 2);
+        QCOMPARE(partOfType(newItem, "PLD:RFC822").data(), QByteArray("internal payload"));
+
+        const Part newExternalPart = partOfType(newItem, "PLD:ATTACHMENT");
+        QVERIFY(newExternalPart.isValid());
+        QVERIFY(!newExternalPart.external());
+        QVERIFY(newExternalPart.data().isEmpty());
+        QCOMPARE(newExternalPart.datasize(), 0ll);
+    }
+};
+
+AKTEST_FAKESERVER_MAIN(CopyHandlerTest)
+
+#include "copyhandlertest.moc"
@@ -0,0 +1,245 @@
+/*
+    Copyright (c) 2014 Akonadi developers
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+#include <storage/entitycache.h>
+#include <entities.h>
+#include <aktest.h>
+
+#include <QObject>
+#include <QThread>
+#include <QTest>
+
+using namespace Akonadi::Server;
+
+class CacheReader : public QThread
+{
+  public:
+    CacheReader( const EntityCache<QString, Flag> *flags, const EntityCache<qint64, PartType> *partTypes,
+                 int count, int iterations )
+      : mFlags( flags )
+      , mPartTypes( partTypes )
+      , mCount( count )
+      , mIterations( iterations )
+      , mMisses( 0 )
+    {
+    }
+
+    int misses() const
+    {
+      return mMisses;
+    }
+
+  protected:
+    void run()
+    {
+      for ( int i = 0; i < mIterations; ++i ) {
+        const int n = i % mCount;
+        Flag flag;
+        PartType partType;
+        if ( !mFlags->find( QString::fromLatin1( "\\FLAG%1" ).arg( n ), flag ) || flag.id() != n
+             || !mPartTypes->find( n, partType ) || partType.id() != n ) {
+          ++mMisses;
+        }
+      }
+    }
+
+  private:
+    const EntityCache<QString, Flag> *mFlags;
+    const EntityCache<qint64, PartType> *mPartTypes;
+    int mCount;
+    int mIterations;
+    int mMisses;
+};
+
+class CacheWriter : public QThread
+{
+  public:
+    CacheWriter( EntityCache<qint64, PartType> *partTypes, int count )
+      : mPartTypes( partTypes )
+      , mCount( count )
+    {
+    }
+
+  protected:
+    void run()
+    {
+      for ( int i = 0; i < mCount; ++i ) {
+        mPartTypes->insert( i, PartType( i, QString::fromLatin1( "PART%1" ).arg( i ), QLatin1String( "PLD" ) ) );
+      }
+    }
+
+  private:
+    EntityCache<qint64, PartType> *mPartTypes;
+    int mCount;
+};
+
+/// Looks up entries while they are being inserted, entries found must be complete
+class GrowingCacheReader : public QThread
+{
+  public:
+    GrowingCacheReader( const EntityCache<qint64, PartType> *partTypes, int count )
+      : mPartTypes( partTypes )
+      , mCount( count )
+      , mErrors( 0 )
+    {
+    }
+
+    int errors() const
+    {
+      return mErrors;
+    }
+
+  protected:
+    void run()
+    {
+      for ( int i = 0; i < mCount; ++i ) {
+        PartType partType;
+        if ( mPartTypes->find( i, partType )
+             && ( partType.id() != i || partType.name() != QString::fromLatin1( "PART%1" ).arg( i ) ) ) {
+          ++mErrors;
+        }
+      }
+    }
+
+  private:
+    const EntityCache<qint64, PartType> *mPartTypes;
+    int mCount;
+    int mErrors;
+};
+
+class EntityCacheTest : public QObject
+{
+  Q_OBJECT
+
+  private:
+    void populate( EntityCache<QString, Flag> &flags, EntityCache<qint64, PartType> &partTypes, int count )
+    {
+      for ( int i = 0; i < count; ++i ) {
+        const Flag flag( i, QString::fromLatin1( "\\FLAG%1" ).arg( i ) );
+        flags.insert( flag.name(), flag );
+        const PartType partType( i, QString::fromLatin1( "PART%1" ).arg( i ), QLatin1String( "PLD" ) );
+        partTypes.insert( partType.id(), partType );
+      }
+    }
+
+    int runReaders( const EntityCache<QString, Flag> &flags, const EntityCache<qint64, PartType> &partTypes,
+                    int count, int threads, int iterations )
+    {
+      QList<CacheReader *> readers;
+      for ( int i = 0; i < threads; ++i ) {
+        readers << new CacheReader( &flags, &partTypes, count, iterations );
+      }
+      Q_FOREACH ( CacheReader *reader, readers ) {
+        reader->start();
+      }
+      int misses = 0;
+      Q_FOREACH ( CacheReader *reader, readers ) {
+        reader->wait();
+        misses += reader->misses();
+      }
+      qDeleteAll( readers );
+      return misses;
+    }
+
+  private Q_SLOTS:
+    void testLookup()
+    {
+      EntityCache<qint64, Flag> cache;
+      Flag flag;
+      QVERIFY( !cache.contains( 1 ) );
+      QVERIFY( !cache.find( 1, flag ) );
+
+      cache.insert( 1, Flag( 1, QLatin1String( "\\SEEN" ) ) );
+      QVERIFY( cache.contains( 1 ) );
+      QVERIFY( cache.find( 1, flag ) );
+      QCOMPARE( flag.name(), QLatin1String( "\\SEEN" ) );
+
+      cache.insert( 1, Flag( 1, QLatin1String( "\\DELETED" ) ) );
+      QVERIFY( cache.find( 1, flag ) );
+      QCOMPARE( flag.name(), QLatin1String( "\\DELETED" ) );
+
+      cache.insert( 2, Flag( 2, QLatin1String( "\\SEEN" ) ) );
+      cache.remove( 1 );
+      QVERIFY( !cache.contains( 1 ) );
+      QVERIFY( cache.contains( 2 ) );
+
+      cache.clear();
+      QVERIFY( !cache.contains( 2 ) );
+    }
+
+    void testConcurrentLookup()
+    {
+      EntityCache<QString, Flag> flags;
+      EntityCache<qint64, PartType> partTypes;
+      populate( flags, partTypes, 100 );
+
+      QCOMPARE( runReaders( flags, partTypes, 100, 8, 10000 ), 0 );
+
+      // removed entries must not be found anymore
+      flags.clear();
+      partTypes.clear();
+      QCOMPARE( runReaders( flags, partTypes, 100, 8, 100 ), 8 * 100 );
+    }
+
+    void testConcurrentInsert()
+    {
+      const int count = 50000;
+      EntityCache<qint64, PartType> partTypes;
+
+      CacheWriter writer( &partTypes, count );
+      QList<GrowingCacheReader *> readers;
+      for ( int i = 0; i < 4; ++i ) {
+        readers << new GrowingCacheReader( &partTypes, count );
+      }
+      writer.start();
+      Q_FOREACH ( GrowingCacheReader *reader, readers ) {
+        reader->start();
+      }
+      writer.wait();
+      int errors = 0;
+      Q_FOREACH ( GrowingCacheReader *reader, readers ) {
+        reader->wait();
+        errors += reader->errors();
+      }
+      qDeleteAll( readers );
+      QCOMPARE( errors, 0 );
+
+      for ( int i = 0; i < count; ++i ) {
+        QVERIFY( partTypes.contains( i ) );
+      }
+    }
+
+//No point in running the benchmark everytime
+#if 0
+    void benchmarkConcurrentLookup()
+    {
+      EntityCache<QString, Flag> flags;
+      EntityCache<qint64, PartType> partTypes;
+      populate( flags, partTypes, 50 );
+
+      QBENCHMARK {
+        QCOMPARE( runReaders( flags, partTypes, 50, 32, 100000 ), 0 );
+      }
+    }
+#endif
+};
+
+AKTEST_MAIN( EntityCacheTest )
+
+#include "entitycachetest.moc"
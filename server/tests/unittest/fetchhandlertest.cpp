@@ -21,6 +21,8 @@
 
 #include <imapstreamparser.h>
 #include <response.h>
+#include <storage/parttypehelper.h>
+#include <storage/storagedebugger.h>
 
 #include "fakeakonadiserver.h"
 #include "aktest.h"
@@ -64,6 +66,25 @@ public:
 
     QScopedPointer<DbInitializer> initializer;
 
+    RelationType relationType()
+    {
+        RelationType type = RelationType::retrieveByName(QLatin1String("type"));
+        if (!type.isValid()) {
+            type.setName(QLatin1String("type"));
+            type.insert();
+        }
+        return type;
+    }
+
+    void createRelation(const PimItem &left, const PimItem &right, const RelationType &type)
+    {
+        Relation relation;
+        relation.setLeftId(left.id());
+        relation.setRightId(right.id());
+        relation.setTypeId(type.id());
+        QVERIFY(relation.insert());
+    }
+
 private Q_SLOTS:
     void testFetch_data()
     {
@@ -173,6 +194,55 @@ private Q_SLOTS:
         FakeAkonadiServer::instance()->runTest();
     }
 
+    void testFetchFullTags_data()
+    {
+        initializer.reset(new DbInitializer);
+        Resource res = initializer->createResource("testresource");
+        Collection col = initializer->createCollection("root");
+        PimItem item1 = initializer->createItem("item1", col);
+        PimItem item2 = initializer->createItem("item2", col);
+        PimItem item3 = initializer->createItem("item3", col);
+
+        TagType type = TagType::retrieveByName(QLatin1String("PLAIN"));
+        if (!type.isValid()) {
+            type.setName(QLatin1String("PLAIN"));
+            type.insert();
+        }
+        Tag tag;
+        tag.setTagType(type);
+        tag.setGid(QLatin1String("gid"));
+        tag.insert();
+
+        item1.addTag(tag);
+        item1.update();
+        item2.addTag(tag);
+        item2.update();
+
+        const QByteArray tags = "TAGS ((UID " + QByteArray::number(tag.id()) + " GID \"gid\" PARENT 0 MIMETYPE \"PLAIN\") )";
+
+        QTest::addColumn<QList<QByteArray> >("scenario");
+
+        {
+            QList<QByteArray> scenario;
+            scenario << FakeAkonadiServer::defaultScenario()
+            << "C: 2 FETCH 1:* COLLECTIONID " + QByteArray::number(col.id()) + " CACHEONLY (UID COLLECTIONID TAGS (UID))"
+            << "S: * " + QByteArray::number(item3.id()) + " FETCH (UID " + QByteArray::number(item3.id()) + " REV 0 MIMETYPE \"test\" COLLECTIONID " + QByteArray::number(col.id()) + " TAGS ())"
+            << "S: * " + QByteArray::number(item2.id()) + " FETCH (UID " + QByteArray::number(item2.id()) + " REV 0 MIMETYPE \"test\" COLLECTIONID " + QByteArray::number(col.id()) + " " + tags + ")"
+            << "S: * " + QByteArray::number(item1.id()) + " FETCH (UID " + QByteArray::number(item1.id()) + " REV 0 MIMETYPE \"test\" COLLECTIONID " + QByteArray::number(col.id()) + " " + tags + ")"
+            << "S: 2 OK FETCH completed";
+
+            QTest::newRow("fetch full tags") << scenario;
+        }
+    }
+
+    void testFetchFullTags()
+    {
+        QFETCH(QList<QByteArray>, scenario);
+
+        FakeAkonadiServer::instance()->setScenario(scenario);
+        FakeAkonadiServer::instance()->runTest();
+    }
+
     void testFetchCommandContext_data()
     {
         initializer.reset(new DbInitializer);
@@ -217,6 +287,81 @@ private Q_SLOTS:
         FakeAkonadiServer::instance()->runTest();
     }
 
+    void testFetchRelations_data()
+    {
+        initializer.reset(new DbInitializer);
+        Resource res = initializer->createResource("testresource");
+        Collection col = initializer->createCollection("root");
+        PimItem item1 = initializer->createItem("item1", col);
+        PimItem item2 = initializer->createItem("item2", col);
+        PimItem item3 = initializer->createItem("item3", col);
+
+        const RelationType type = relationType();
+        createRelation(item1, item2, type);
+
+        const QByteArray relation = "RELATIONS ((LEFT " + QByteArray::number(item1.id()) + " RIGHT " + QByteArray::number(item2.id()) + " TYPE type) )";
+
+        QTest::addColumn<QList<QByteArray> >("scenario");
+
+        {
+            QList<QByteArray> scenario;
+            scenario << FakeAkonadiServer::defaultScenario()
+            << "C: 2 FETCH 1:* COLLECTIONID " + QByteArray::number(col.id()) + " CACHEONLY (UID COLLECTIONID RELATIONS)"
+            << "S: * " + QByteArray::number(item3.id()) + " FETCH (UID " + QByteArray::number(item3.id()) + " REV 0 MIMETYPE \"test\" COLLECTIONID " + QByteArray::number(col.id()) + " RELATIONS ())"
+            << "S: * " + QByteArray::number(item2.id()) + " FETCH (UID " + QByteArray::number(item2.id()) + " REV 0 MIMETYPE \"test\" COLLECTIONID " + QByteArray::number(col.id()) + " " + relation + ")"
+            << "S: * " + QByteArray::number(item1.id()) + " FETCH (UID " + QByteArray::number(item1.id()) + " REV 0 MIMETYPE \"test\" COLLECTIONID " + QByteArray::number(col.id()) + " " + relation + ")"
+            << "S: 2 OK FETCH completed";
+
+            QTest::newRow("fetch relations") << scenario;
+        }
+    }
+
+    void testFetchRelations()
+    {
+        QFETCH(QList<QByteArray>, scenario);
+
+        FakeAkonadiServer::instance()->setScenario(scenario);
+        FakeAkonadiServer::instance()->runTest();
+    }
+
+    void testFetchRelationsQueryCount()
+    {
+        initializer.reset(new DbInitializer);
+        Resource res = initializer->createResource("testresource");
+        const RelationType type = relationType();
+
+        // The number of executed queries must not depend on the number of
+        // fetched items
+        QList<qint64> queryCounts;
+        Q_FOREACH (int count, QList<int>() << 10 << 500) {
+            Collection col = initializer->createCollection(QByteArray("col" + QByteArray::number(count)).constData());
+            PimItem previous;
+            for (int i = 0; i < count; ++i) {
+                const PimItem item = initializer->createItem(QByteArray::number(i).constData(), col);
+                if (previous.isValid()) {
+                    createRelation(previous, item, type);
+                }
+                previous = item;
+            }
+
+            QList<QByteArray> scenario;
+            scenario << FakeAkonadiServer::defaultScenario()
+            << "C: 2 FETCH 1:* COLLECTIONID " + QByteArray::number(col.id()) + " CACHEONLY (UID COLLECTIONID RELATIONS)"
+            << "S: IGNORE " + QByteArray::number(count)
+            << "S: 2 OK FETCH completed";
+
+            QElapsedTimer timer;
+            timer.start();
+            const qint64 queriesBefore = StorageDebugger::instance()->executedQueriesCount();
+            FakeAkonadiServer::instance()->setScenario(scenario);
+            FakeAkonadiServer::instance()->runTest();
+            queryCounts << StorageDebugger::instance()->executedQueriesCount() - queriesBefore;
+            akDebug() << "Fetched relations of" << count << "items with" << queryCounts.last() << "queries in" << timer.nsecsElapsed()/1.0e6 << "ms";
+        }
+
+        QCOMPARE(queryCounts.first(), queryCounts.last());
+    }
+
     void testList_data()
     {
         QElapsedTimer timer;
@@ -258,6 +403,52 @@ private Q_SLOTS:
         FakeAkonadiServer::instance()->runTest();
     }
 
+//No point in running the benchmark everytime
+#if 0
+
+    void testFetchPayloadBenchmark_data()
+    {
+        initializer.reset(new DbInitializer);
+        Resource res = initializer->createResource("testresource");
+        Collection col = initializer->createCollection("col1");
+
+        const PartType partType = PartTypeHelper::fromFqName(QLatin1String("PLD:RFC822"));
+        const QByteArray payload(50 * 1024, 'x');
+        const int count = 10000;
+        for (int i = 0; i < count; ++i) {
+            const PimItem item = initializer->createItem(QByteArray::number(i).constData(), col);
+            Part part;
+            part.setPimItemId(item.id());
+            part.setPartType(partType);
+            part.setData(payload);
+            part.setDatasize(payload.size());
+            part.insert();
+        }
+
+        QTest::addColumn<QList<QByteArray> >("scenario");
+
+        {
+            QList<QByteArray> scenario;
+            scenario << FakeAkonadiServer::defaultScenario()
+                    << "C: 2 FETCH 1:* COLLECTIONID " + QByteArray::number(col.id()) + " CACHEONLY (UID COLLECTIONID PLD:RFC822)"
+                    << "S: IGNORE " + QByteArray::number(count)
+                    << "S: 2 OK FETCH completed";
+            QTest::newRow("fetch 10k items with 50KB payloads") << scenario;
+        }
+    }
+
+    void testFetchPayloadBenchmark()
+    {
+        QFETCH(QList<QByteArray>, scenario);
+
+        QBENCHMARK {
+            FakeAkonadiServer::instance()->setScenario(scenario);
+            FakeAkonadiServer::instance()->runTest();
+        }
+    }
+
+#endif
+
 };
 
 AKTEST_FAKESERVER_MAIN(FetchHandlerTest)
@@ -68,6 +68,79 @@ QString akBacktrace()
 
 AKTEST_MAIN( ImapStreamParserTest )
 
+/**
+ * Sequential device handing out its data in chunks of a fixed size, one chunk
+ * per waitForReadyRead(), like a socket would.
+ */
+class ChunkedDevice : public QIODevice
+{
+  public:
+    ChunkedDevice( const QByteArray &data, int chunkSize )
+      : mData( data )
+      , mPosition( 0 )
+      , mAvailable( 0 )
+      , mChunkSize( chunkSize )
+    {
+      open( QIODevice::ReadWrite | QIODevice::Unbuffered );
+    }
+
+    virtual bool isSequential() const
+    {
+      return true;
+    }
+
+    virtual qint64 bytesAvailable() const
+    {
+      return mAvailable + QIODevice::bytesAvailable();
+    }
+
+    virtual bool waitForReadyRead( int msecs )
+    {
+      Q_UNUSED( msecs );
+      mAvailable = qMin( mChunkSize, mData.size() - mPosition );
+      return mAvailable > 0;
+    }
+
+    virtual bool waitForBytesWritten( int msecs )
+    {
+      Q_UNUSED( msecs );
+      return true;
+    }
+
+  protected:
+    virtual qint64 readData( char *data, qint64 maxSize )
+    {
+      const int size = qMin( qint64( mAvailable ), maxSize );
+      memcpy( data, mData.constData() + mPosition, size );
+      mPosition += size;
+      mAvailable -= size;
+      return size;
+    }
+
+    virtual qint64 writeData( const char *data, qint64 maxSize )
+    {
+      // ignore continuation responses
+      Q_UNUSED( data );
+      return maxSize;
+    }
+
+  private:
+    QByteArray mData;
+    int mPosition;
+    int mAvailable;
+    int mChunkSize;
+};
+
+static QByteArray literalPayload( int size )
+{
+  QByteArray payload;
+  payload.reserve( size );
+  for ( int i = 0; i < size; ++i ) {
+    payload.append( static_cast<char>( 'a' + i % 26 ) );
+  }
+  return payload;
+}
+
 void ImapStreamParserTest::testParseQuotedString()
 {
   QByteArray result;
@@ -465,3 +538,54 @@ void ImapStreamParserTest::testAbortCommand()
     QFAIL( "Exception caught" );
   }
 }
+
+void ImapStreamParserTest::testReadLiteral()
+{
+  const QByteArray payload1 = literalPayload( 300000 );
+  const QByteArray payload2 = literalPayload( 5000 );
+  ChunkedDevice device( "1 {" + QByteArray::number( payload1.size() ) + "}\n" + payload1
+                        + " {" + QByteArray::number( payload2.size() ) + "}\n" + payload2
+                        + " NEXTCOMMAND\n", 4093 );
+  ImapStreamParser parser( &device );
+
+  try {
+    QCOMPARE( parser.readString(), QByteArray( "1" ) );
+    QVERIFY( parser.hasLiteral() );
+    QCOMPARE( parser.remainingLiteralSize(), qint64( payload1.size() ) );
+    QByteArray literal;
+    while ( !parser.atLiteralEnd() ) {
+      const QByteArray part = parser.readLiteralPart();
+      QVERIFY( !part.isEmpty() );
+      literal += part;
+    }
+    QCOMPARE( literal, payload1 );
+
+    QCOMPARE( parser.readString(), payload2 );
+    QCOMPARE( parser.readString(), QByteArray( "NEXTCOMMAND" ) );
+    QVERIFY( parser.atCommandEnd() );
+  } catch ( const Akonadi::Server::Exception &e ) {
+    qDebug() << e.type() << e.what();
+    QFAIL( "Exception caught" );
+  }
+}
+
+//No point in running the benchmark everytime
+#if 0
+void ImapStreamParserTest::benchmarkReadLiteral()
+{
+  const QByteArray payload = literalPayload( 30 * 1024 * 1024 );
+  const QByteArray input = "1 {" + QByteArray::number( payload.size() ) + "}\n" + payload + "\n";
+
+  QBENCHMARK {
+    ChunkedDevice device( input, 64 * 1024 );
+    ImapStreamParser parser( &device );
+    parser.readString();
+    parser.hasLiteral();
+    qint64 size = 0;
+    while ( !parser.atLiteralEnd() ) {
+      size += parser.readLiteralPart().size();
+    }
+    QCOMPARE( size, qint64( payload.size() ) );
+  }
+}
+#endif
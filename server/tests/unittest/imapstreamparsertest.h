@@ -40,6 +40,12 @@ class ImapStreamParserTest : public QObject
     void testReadUntilCommandEnd();
     void testReadUntilCommandEnd2();
     void testAbortCommand();
+    void testReadLiteral();
+
+//No point in running the benchmark everytime
+#if 0
+    void benchmarkReadLiteral();
+#endif
 
 };
 
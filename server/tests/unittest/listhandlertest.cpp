@@ -541,6 +541,89 @@ private Q_SLOTS:
         }
     }
 
+    void testListHierarchyBenchmark_data()
+    {
+        //8 toplevel folders with 10 subfolders with 10 folders each, and a minimal hierarchy of the same depth.
+        //Only the leaves have a mimetype, so the filtered listing has to complete the tree.
+        //Both stay below the 999 ids per batch of mimetypes and attributes, so they must take the same number of queries.
+        initializer.reset(new DbInitializer);
+        Resource res = initializer->createResource("testresource");
+
+        MimeType mt1 = MimeType::retrieveByName(QLatin1String("mimetype1"));
+
+        Collection toplevel = initializer->createCollection("toplevel");
+        for (int i = 0; i < 8; i++) {
+            Collection col1 = initializer->createCollection(QString::fromLatin1("col%1").arg(i).toLatin1().data(), toplevel);
+            for (int j = 0; j < 10; j++) {
+                Collection col2 = initializer->createCollection(QString::fromLatin1("col%1-%2").arg(i).arg(j).toLatin1().data(), col1);
+                for (int k = 0; k < 10; k++) {
+                    Collection col3 = initializer->createCollection(QString::fromLatin1("col%1-%2-%3").arg(i).arg(j).arg(k).toLatin1().data(), col2);
+                    col3.addMimeType(mt1);
+                    col3.update();
+                }
+            }
+        }
+
+        Collection smallTop = initializer->createCollection("small");
+        Collection small1 = initializer->createCollection("small1", smallTop);
+        Collection small2 = initializer->createCollection("small2", small1);
+        Collection small3 = initializer->createCollection("small3", small2);
+        small3.addMimeType(mt1);
+        small3.update();
+
+        QTest::addColumn<QList<QByteArray> >("scenario");
+        QTest::addColumn<QList<QByteArray> >("smallScenario");
+
+        {
+            QList<QByteArray> scenario;
+            scenario << FakeAkonadiServer::defaultScenario()
+                    << "C: 2 LIST " + QByteArray::number(toplevel.id()) + " INF () (ANCESTORS INF)"
+                    << "S: IGNORE 888"
+                    << "S: 2 OK List completed";
+            QList<QByteArray> smallScenario;
+            smallScenario << FakeAkonadiServer::defaultScenario()
+                    << "C: 2 LIST " + QByteArray::number(smallTop.id()) + " INF () (ANCESTORS INF)"
+                    << "S: IGNORE 3"
+                    << "S: 2 OK List completed";
+            QTest::newRow("recursive list with ancestors") << scenario << smallScenario;
+        }
+        {
+            QList<QByteArray> scenario;
+            scenario << FakeAkonadiServer::defaultScenario()
+                    << "C: 2 LIST " + QByteArray::number(toplevel.id()) + " INF (MIMETYPE (mimetype1)) (ANCESTORS INF)"
+                    << "S: IGNORE 888"
+                    << "S: 2 OK List completed";
+            QList<QByteArray> smallScenario;
+            smallScenario << FakeAkonadiServer::defaultScenario()
+                    << "C: 2 LIST " + QByteArray::number(smallTop.id()) + " INF (MIMETYPE (mimetype1)) (ANCESTORS INF)"
+                    << "S: IGNORE 3"
+                    << "S: 2 OK List completed";
+            QTest::newRow("recursive list filtered by mimetype with ancestors") << scenario << smallScenario;
+        }
+    }
+
+    void testListHierarchyBenchmark()
+    {
+        QFETCH(QList<QByteArray>, scenario);
+        QFETCH(QList<QByteArray>, smallScenario);
+
+        //The number of queries must not depend on the number of collections (except for the batching of mimetypes and attributes)
+        QList<qint64> queryCounts;
+        Q_FOREACH (const QList<QByteArray> &s, QList<QList<QByteArray> >() << smallScenario << scenario) {
+            const qint64 queriesBefore = StorageDebugger::instance()->executedQueriesCount();
+            FakeAkonadiServer::instance()->setScenario(s);
+            FakeAkonadiServer::instance()->runTest();
+            queryCounts << StorageDebugger::instance()->executedQueriesCount() - queriesBefore;
+        }
+        qDebug() << "Listing executed" << queryCounts.last() << "queries";
+        QCOMPARE(queryCounts.first(), queryCounts.last());
+
+        QBENCHMARK {
+            FakeAkonadiServer::instance()->setScenario(scenario);
+            FakeAkonadiServer::instance()->runTest();
+        }
+    }
+
 #endif
 
 };
@@ -40,6 +40,23 @@ class NotificationManagerTest : public QObject
 
   typedef QList<NotificationSource *> NSList;
 
+  // each notification is about a different item, so that they are not compressed
+  static NotificationMessageV3::List itemNotifications( int count )
+  {
+    static int nextId = 1;
+    NotificationMessageV3::List list;
+    for ( int i = 0; i < count; ++i ) {
+      NotificationMessageV3 msg;
+      msg.setType( NotificationMessageV2::Items );
+      msg.setOperation( NotificationMessageV2::Add );
+      msg.setParentCollection( 1 );
+      msg.setResource( "akonadi_fake_resource_0" );
+      msg.addEntity( nextId++, QString(), QString(), QLatin1String( "message/rfc822" ) );
+      list << msg;
+    }
+    return list;
+  }
+
   private Q_SLOTS:
     void testSourceFilter_data()
     {
@@ -307,6 +324,180 @@ class NotificationManagerTest : public QObject
         QCOMPARE( list.count(), accepted ? 1 : 0 );
       }
     }
+
+    void testRouting()
+    {
+      ClientCapabilities caps;
+      caps.setNotificationMessageVersion( 3 );
+      ClientCapabilityAggregator::addSession( caps );
+
+      NotificationManager mgr;
+      NotificationSource colSource( QLatin1String( "colSource" ), QString(), &mgr );
+      colSource.setServerSideMonitorEnabled( true );
+      mgr.registerSource( &colSource );
+      colSource.setMonitoredCollection( 1, true );
+
+      NotificationSource resSource( QLatin1String( "resSource" ), QString(), &mgr );
+      resSource.setServerSideMonitorEnabled( true );
+      mgr.registerSource( &resSource );
+      resSource.setMonitoredResource( "akonadi_fake_resource_0", true );
+
+      NotificationSource allSource( QLatin1String( "allSource" ), QString(), &mgr );
+      allSource.setServerSideMonitorEnabled( true );
+      mgr.registerSource( &allSource );
+      allSource.setAllMonitored( true );
+
+      QSignalSpy colSpy( &colSource, SIGNAL(notifyV3(Akonadi::NotificationMessageV3::List)) );
+      QSignalSpy resSpy( &resSource, SIGNAL(notifyV3(Akonadi::NotificationMessageV3::List)) );
+      QSignalSpy allSpy( &allSource, SIGNAL(notifyV3(Akonadi::NotificationMessageV3::List)) );
+
+      NotificationMessageV3::List list;
+      for ( int i = 1; i <= 3; ++i ) {
+        NotificationMessageV3 msg;
+        msg.setType( NotificationMessageV2::Items );
+        msg.setOperation( NotificationMessageV2::Add );
+        msg.setParentCollection( i );
+        msg.setResource( "akonadi_fake_resource_" + QByteArray::number( i % 2 ) );
+        msg.addEntity( i, QString(), QString(), QLatin1String( "message/rfc822" ) );
+        list << msg;
+      }
+      mgr.slotNotify( list );
+      mgr.emitPendingNotifications();
+
+      QCOMPARE( colSpy.count(), 1 );
+      list = colSpy.at( 0 ).at( 0 ).value<NotificationMessageV3::List>();
+      QCOMPARE( list.count(), 1 );
+      QCOMPARE( list.first().parentCollection(), 1ll );
+
+      QCOMPARE( resSpy.count(), 1 );
+      list = resSpy.at( 0 ).at( 0 ).value<NotificationMessageV3::List>();
+      QCOMPARE( list.count(), 1 );
+      QCOMPARE( list.first().parentCollection(), 2ll );
+
+      QCOMPARE( allSpy.count(), 1 );
+      list = allSpy.at( 0 ).at( 0 ).value<NotificationMessageV3::List>();
+      QCOMPARE( list.count(), 3 );
+
+      // changed subscriptions are picked up by the routing
+      colSource.setMonitoredCollection( 1, false );
+      colSource.setMonitoredCollection( 3, true );
+      colSpy.clear();
+      mgr.slotNotify( list );
+      mgr.emitPendingNotifications();
+      QCOMPARE( colSpy.count(), 1 );
+      list = colSpy.at( 0 ).at( 0 ).value<NotificationMessageV3::List>();
+      QCOMPARE( list.count(), 1 );
+      QCOMPARE( list.first().parentCollection(), 3ll );
+
+      mgr.unregisterSource( &colSource );
+      mgr.unregisterSource( &resSource );
+      mgr.unregisterSource( &allSource );
+    }
+
+    void testAdaptiveInterval()
+    {
+      ClientCapabilities caps;
+      caps.setNotificationMessageVersion( 3 );
+      ClientCapabilityAggregator::addSession( caps );
+
+      NotificationManager mgr;
+      mgr.mBaseInterval = 50;
+      mgr.mInterval = 50;
+      mgr.mMaxInterval = 400;
+      mgr.mMaxBatchSize = 500;
+      NotificationSource source( QLatin1String( "allSource" ), QString(), &mgr );
+      source.setServerSideMonitorEnabled( true );
+      mgr.registerSource( &source );
+      source.setAllMonitored( true );
+
+      QSignalSpy spy( &source, SIGNAL(notifyV3(Akonadi::NotificationMessageV3::List)) );
+
+      // large batches double the interval up to the maximum, and are split into signals of MaxBatchSize
+      const QList<int> backoff = QList<int>() << 100 << 200 << 400 << 400;
+      Q_FOREACH ( int interval, backoff ) {
+        spy.clear();
+        mgr.slotNotify( itemNotifications( 1200 ) );
+        mgr.emitPendingNotifications();
+        QCOMPARE( mgr.mInterval, interval );
+        QCOMPARE( mgr.statistics().value( QLatin1String( "interval" ) ).toInt(), interval );
+
+        QCOMPARE( spy.count(), 3 );
+        int delivered = 0;
+        for ( int i = 0; i < spy.count(); ++i ) {
+          const int batchSize = spy.at( i ).at( 0 ).value<NotificationMessageV3::List>().count();
+          QVERIFY( batchSize <= 500 );
+          delivered += batchSize;
+        }
+        QCOMPARE( delivered, 1200 );
+      }
+
+      // batches between a tenth of a large batch and a large batch keep the interval
+      mgr.slotNotify( itemNotifications( 500 ) );
+      mgr.emitPendingNotifications();
+      QCOMPARE( mgr.mInterval, 400 );
+
+      // small batches halve it again, down to the configured interval
+      const QList<int> recovery = QList<int>() << 200 << 100 << 50 << 50;
+      Q_FOREACH ( int interval, recovery ) {
+        spy.clear();
+        mgr.slotNotify( itemNotifications( 5 ) );
+        mgr.emitPendingNotifications();
+        QCOMPARE( mgr.mInterval, interval );
+        QCOMPARE( spy.count(), 1 );
+        QCOMPARE( spy.at( 0 ).at( 0 ).value<NotificationMessageV3::List>().count(), 5 );
+      }
+
+      QCOMPARE( mgr.mLastBatchSize, 5 );
+      QCOMPARE( mgr.mFlushCount, 9ll );
+      QCOMPARE( mgr.mEmittedCount, 4 * 1200 + 500 + 4 * 5ll );
+
+      mgr.unregisterSource( &source );
+    }
+
+//No point in running the benchmark everytime
+#if 0
+    void benchmarkRouting()
+    {
+      ClientCapabilities caps;
+      caps.setNotificationMessageVersion( 3 );
+      ClientCapabilityAggregator::addSession( caps );
+
+      NotificationManager mgr;
+      QList<NotificationSource *> sources;
+      for ( int i = 0; i < 80; ++i ) {
+        NotificationSource *source = new NotificationSource( QString::fromLatin1( "source%1" ).arg( i ), QString(), &mgr );
+        source->setServerSideMonitorEnabled( true );
+        mgr.registerSource( source );
+        for ( int j = 0; j < 10; ++j ) {
+          source->setMonitoredCollection( i * 10 + j, true );
+        }
+        source->setIgnoredSession( "session" + QByteArray::number( i ), true );
+        sources << source;
+      }
+
+      NotificationMessageV3::List list;
+      for ( int i = 0; i < 10000; ++i ) {
+        NotificationMessageV3 msg;
+        msg.setType( NotificationMessageV2::Items );
+        msg.setOperation( NotificationMessageV2::Add );
+        msg.setSessionId( "sync" );
+        msg.setParentCollection( i % 800 );
+        msg.setResource( "akonadi_fake_resource_0" );
+        msg.addEntity( i, QString(), QString(), QLatin1String( "message/rfc822" ) );
+        list << msg;
+      }
+
+      QBENCHMARK {
+        mgr.slotNotify( list );
+        mgr.emitPendingNotifications();
+      }
+
+      Q_FOREACH ( NotificationSource *source, sources ) {
+        mgr.unregisterSource( source );
+      }
+      qDeleteAll( sources );
+    }
+#endif
 };
 
 AKTEST_MAIN( NotificationManagerTest )
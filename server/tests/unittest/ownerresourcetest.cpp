@@ -0,0 +1,89 @@
+/*
+    Copyright (c) 2014 Akonadi developers
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+#include <QObject>
+
+#include "fakeakonadiserver.h"
+#include "fakeconnection.h"
+#include "aktest.h"
+#include "akdebug.h"
+#include "entities.h"
+#include "dbinitializer.h"
+
+#include <storage/datastore.h>
+
+#include <QtTest/QTest>
+
+using namespace Akonadi;
+using namespace Akonadi::Server;
+
+class OwnerResourceTest : public QObject
+{
+    Q_OBJECT
+
+public:
+    OwnerResourceTest()
+    {
+        try {
+            FakeAkonadiServer::instance()->setPopulateDb(false);
+            FakeAkonadiServer::instance()->init();
+        } catch (const FakeAkonadiServerException &e) {
+            akError() << "Server exception: " << e.what();
+            akFatal() << "Fake Akonadi Server failed to start up, aborting test";
+        }
+    }
+
+    ~OwnerResourceTest()
+    {
+        FakeAkonadiServer::instance()->quit();
+    }
+
+private Q_SLOTS:
+    void testOwnerResource()
+    {
+        DbInitializer initializer;
+        const Resource resource = initializer.createResource("ownerresource");
+        Collection col = initializer.createCollection("col");
+        const PimItem item = initializer.createItem("item", col);
+        DbInitializer otherInitializer;
+        otherInitializer.createResource("otherresource");
+        const Collection otherCol = otherInitializer.createCollection("othercol");
+        const PimItem otherItem = otherInitializer.createItem("otheritem", otherCol);
+
+        FakeConnection connection;
+        // not a resource
+        QVERIFY(!connection.isOwnerResource(item));
+        QVERIFY(!connection.isOwnerResource(col));
+
+        connection.context()->setResource(resource);
+        QVERIFY(connection.isOwnerResource(item));
+        QVERIFY(connection.isOwnerResource(col));
+        QVERIFY(!connection.isOwnerResource(otherItem));
+        QVERIFY(!connection.isOwnerResource(otherCol));
+
+        // moving the collection to another resource is noticed
+        QVERIFY(DataStore::self()->moveCollection(col, otherCol));
+        QVERIFY(!connection.isOwnerResource(item));
+        QVERIFY(!connection.isOwnerResource(col));
+    }
+};
+
+AKTEST_FAKESERVER_MAIN(OwnerResourceTest)
+
+#include "ownerresourcetest.moc"
@@ -151,6 +151,70 @@ void QueryBuilderTest::testQueryBuilder_data()
   mBuilders << qb;
   QTest::newRow( "insert multi column PSQL without id" ) << mBuilders.count() << QString( "INSERT INTO table (col1, col2) VALUES (:0, :1)" ) << bindVals;
 
+  qb = QueryBuilder( "table", QueryBuilder::Insert );
+  qb.setDatabaseType( DbType::PostgreSQL );
+  qb.setColumnValue( "col1", QString( "bla" ) );
+  qb.addColumns( QStringList() << "col2" << "col3" );
+  qb.addValueCondition( "col1", Query::Equals, 5 );
+  mBuilders << qb;
+  QTest::newRow( "insert select" ) << mBuilders.count() << QString( "INSERT INTO table (col1, col2, col3) SELECT :0, col2, col3 FROM table WHERE ( col1 = :1 )" ) << bindVals;
+
+  QList<QVariant> batchBindVals;
+  qb = QueryBuilder( "table", QueryBuilder::Insert );
+  qb.setColumnValue( "col1", QVariantList() << 1 << 2 );
+  qb.setColumnValue( "col2", QString( "bla" ) );
+  qb.setIdentificationColumn( QString() );
+  batchBindVals << QVariant( QVariantList() << 1 << 2 ) << QString( "bla" );
+  mBuilders << qb;
+  QTest::newRow( "insert batch" ) << mBuilders.count() << QString( "INSERT INTO table (col1, col2) VALUES (:0, :1)" ) << batchBindVals;
+
+  qb.setDatabaseType( DbType::MySQL );
+  batchBindVals.clear();
+  batchBindVals << 1 << QString( "bla" ) << 2 << QString( "bla" );
+  mBuilders << qb;
+  QTest::newRow( "insert batch MySQL" ) << mBuilders.count() << QString( "INSERT INTO table (col1, col2) VALUES (:0, :1), (:2, :3)" ) << batchBindVals;
+
+  qb = QueryBuilder( "table", QueryBuilder::Insert );
+  qb.setDatabaseType( DbType::PostgreSQL );
+  qb.setColumnValue( "col1", QVariantList() << 1 << 2 << 3 );
+  qb.setColumnValue( "col2", QString( "bla" ) );
+  // three rows are inserted in chunks of two and one row
+  batchBindVals.clear();
+  batchBindVals << 3 << QString( "bla" );
+  mBuilders << qb;
+  QTest::newRow( "insert batch PSQL" ) << mBuilders.count() << QString( "INSERT INTO table (col1, col2) VALUES (:0, :1)" ) << batchBindVals;
+
+  // at most 1024 rows go into one statement
+  QVariantList manyValues;
+  QStringList placeholders;
+  batchBindVals.clear();
+  for ( int i = 0; i < 1024; ++i ) {
+    manyValues << i;
+    placeholders << QString::fromLatin1( "(:%1)" ).arg( i );
+    batchBindVals << i;
+  }
+  qb = QueryBuilder( "table", QueryBuilder::Insert );
+  qb.setDatabaseType( DbType::MySQL );
+  qb.setColumnValue( "col1", manyValues );
+  mBuilders << qb;
+  QTest::newRow( "insert batch max rows" ) << mBuilders.count()
+                                          << QString( "INSERT INTO table (col1) VALUES " ) + placeholders.join( ", " )
+                                          << batchBindVals;
+
+  // 1500 rows are inserted in chunks of 1024, 256, 128, 64, 16, 8 and 4 rows
+  for ( int i = 1024; i < 1500; ++i ) {
+    manyValues << i;
+  }
+  qb = QueryBuilder( "table", QueryBuilder::Insert );
+  qb.setDatabaseType( DbType::MySQL );
+  qb.setColumnValue( "col1", manyValues );
+  batchBindVals.clear();
+  batchBindVals << 1496 << 1497 << 1498 << 1499;
+  mBuilders << qb;
+  QTest::newRow( "insert batch chunked" ) << mBuilders.count()
+                                         << QString( "INSERT INTO table (col1) VALUES (:0), (:1), (:2), (:3)" )
+                                         << batchBindVals;
+
   // test GROUP BY foo
   bindVals.clear();
   qb = QueryBuilder( "table", QueryBuilder::Select );
@@ -271,3 +335,102 @@ void QueryBuilderTest::testQueryBuilder()
   QCOMPARE( mBuilders[qbId].mStatement, sql );
   QCOMPARE( mBuilders[qbId].mBindValues, bindValues );
 }
+
+void QueryBuilderTest::testStatementShape()
+{
+  // shapes are compared by address, don't rely on the compiler merging string literals
+  static const char shape[] = "QueryBuilderTest::testStatementShape";
+
+  QueryBuilder qb( "table", QueryBuilder::Select );
+  qb.addColumn( "col1" );
+  qb.addValueCondition( "col2", Query::Equals, 5 );
+  qb.setStatementShape( shape );
+  QVERIFY( qb.exec() );
+  QCOMPARE( qb.mStatement, QString( "SELECT col1 FROM table WHERE ( col2 = :0 )" ) );
+  QCOMPARE( qb.mBindValues, QList<QVariant>() << 5 );
+
+  // the statement is reused, only the values are collected again
+  QueryBuilder qb2( "table", QueryBuilder::Select );
+  qb2.addColumn( "col1" );
+  qb2.addValueCondition( "col2", Query::Equals, 7 );
+  qb2.setStatementShape( shape );
+  QVERIFY( qb2.exec() );
+  QCOMPARE( qb2.mStatement, qb.mStatement );
+  QCOMPARE( qb2.mBindValues, QList<QVariant>() << 7 );
+
+  // the cached statement is used without building the query, so a query which
+  // wrongly declares the same shape gets the statement of the first one
+  QueryBuilder qbReused( "table", QueryBuilder::Select );
+  qbReused.addColumn( "col9" );
+  qbReused.addValueCondition( "col8", Query::Equals, 9 );
+  qbReused.setStatementShape( shape );
+  QVERIFY( qbReused.exec() );
+  QCOMPARE( qbReused.mStatement, QString( "SELECT col1 FROM table WHERE ( col2 = :0 )" ) );
+  QCOMPARE( qbReused.mBindValues, QList<QVariant>() << 9 );
+
+  // a different number of values rebuilds the statement
+  QueryBuilder qb3( "table", QueryBuilder::Select );
+  qb3.addColumn( "col1" );
+  qb3.addValueCondition( "col2", Query::In, QVariantList() << 1 << 2 );
+  qb3.setStatementShape( shape );
+  QVERIFY( qb3.exec() );
+  QCOMPARE( qb3.mStatement, QString( "SELECT col1 FROM table WHERE ( col2 IN ( :0, :1 ) )" ) );
+  QCOMPARE( qb3.mBindValues, QList<QVariant>() << 1 << 2 );
+
+  // as does a different database type
+  QueryBuilder qb4( "table", QueryBuilder::Select );
+  qb4.setDatabaseType( DbType::PostgreSQL );
+  qb4.addColumn( "col1" );
+  qb4.addValueCondition( "col2", Query::Equals, 5 );
+  qb4.setStatementShape( shape );
+  QVERIFY( qb4.exec() );
+  QCOMPARE( qb4.mStatement, QString( "SELECT col1 FROM table WHERE ( col2 = :0 )" ) );
+  QCOMPARE( qb4.mBindValues, QList<QVariant>() << 5 );
+
+  // the values of UPDATE queries are collected in the same order as they are bound
+  for ( int i = 0; i < 2; ++i ) {
+    QueryBuilder qb5( "table", QueryBuilder::Update );
+    qb5.setColumnValue( "col1", i );
+    qb5.setColumnValue( "col2", QString( "foo" ) );
+    qb5.addValueCondition( "col3", Query::Equals, 10 + i );
+    qb5.addColumnCondition( "col4", Query::Equals, "col5" );
+    qb5.addValueCondition( "col6", Query::Is, QVariant() );
+    qb5.setStatementShape( "QueryBuilderTest::testStatementShape::update" );
+    QVERIFY( qb5.exec() );
+    QCOMPARE( qb5.mStatement, QString( "UPDATE table SET col1 = :0, col2 = :1 WHERE ( col3 = :2 AND col4 = col5 AND col6 IS NULL )" ) );
+    QCOMPARE( qb5.mBindValues, QList<QVariant>() << i << QString( "foo" ) << 10 + i );
+  }
+}
+
+//No point in running the benchmark everytime
+#if 0
+void QueryBuilderTest::benchmarkStatementShape_data()
+{
+  QTest::addColumn<bool>( "shaped" );
+
+  QTest::newRow( "built" ) << false;
+  QTest::newRow( "reused" ) << true;
+}
+
+void QueryBuilderTest::benchmarkStatementShape()
+{
+  QFETCH( bool, shaped );
+
+  QStringList columns;
+  for ( int i = 0; i < 15; ++i ) {
+    columns << QString( "PimItemTable.column%1" ).arg( i );
+  }
+
+  QBENCHMARK {
+    for ( int i = 0; i < 10000; ++i ) {
+      QueryBuilder qb( "PimItemTable", QueryBuilder::Select );
+      qb.addColumns( columns );
+      qb.addValueCondition( "PimItemTable.id", Query::Equals, i );
+      if ( shaped ) {
+        qb.setStatementShape( "QueryBuilderTest::benchmarkStatementShape" );
+      }
+      qb.exec();
+    }
+  }
+}
+#endif
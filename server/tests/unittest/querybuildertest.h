@@ -36,6 +36,13 @@ class QueryBuilderTest : public QObject
   private Q_SLOTS:
     void testQueryBuilder_data();
     void testQueryBuilder();
+    void testStatementShape();
+
+//No point in running the benchmark everytime
+#if 0
+    void benchmarkStatementShape_data();
+    void benchmarkStatementShape();
+#endif
 
   private:
     QList< Akonadi::Server::QueryBuilder > mBuilders;
@@ -0,0 +1,142 @@
+/*
+    Copyright (c) 2014 Akonadi developers
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+#include <ringbuffertracer.h>
+#include <aktest.h>
+
+#include <QObject>
+#include <QTest>
+#include <QtCore/QtEndian>
+#include <QtCore/QFile>
+#include <QtCore/QTemporaryFile>
+
+using namespace Akonadi::Server;
+
+struct Record
+{
+    int type;
+    QByteArray identifier;
+    QByteArray message;
+};
+
+static QList<Record> parseRecords(const QByteArray &data)
+{
+    QList<Record> records;
+    const uchar *pos = reinterpret_cast<const uchar *>(data.constData());
+    const uchar *end = pos + data.size();
+    while (pos < end) {
+        const int size = qFromLittleEndian<quint32>(pos);
+        const int idSize = qFromLittleEndian<quint16>(pos + 13);
+        Record record;
+        record.type = pos[12];
+        record.identifier = QByteArray(reinterpret_cast<const char *>(pos) + 15, idSize);
+        record.message = QByteArray(reinterpret_cast<const char *>(pos) + 15 + idSize, size - 15 - idSize);
+        records << record;
+        pos += size;
+    }
+    return records;
+}
+
+class RingBufferTracerTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testRecords()
+    {
+        RingBufferTracer tracer(QString(), 4096);
+        tracer.beginConnection(QLatin1String("0x1"), QString());
+        tracer.connectionInput(QLatin1String("0x1"), "2 LOGIN foo");
+        tracer.signal(QLatin1String("NotificationManager::notify"), QString::fromUtf8("\xc3\xa4"));
+
+        const QList<Record> records = parseRecords(tracer.records());
+        QCOMPARE(records.count(), 3);
+        QCOMPARE(records[0].type, static_cast<int>(RingBufferTracer::BeginConnection));
+        QCOMPARE(records[0].identifier, QByteArray("0x1"));
+        QVERIFY(records[0].message.isEmpty());
+        QCOMPARE(records[1].type, static_cast<int>(RingBufferTracer::ConnectionInput));
+        QCOMPARE(records[1].message, QByteArray("2 LOGIN foo"));
+        QCOMPARE(records[2].type, static_cast<int>(RingBufferTracer::Signal));
+        QCOMPARE(records[2].identifier, QByteArray("NotificationManager::notify"));
+        QCOMPARE(records[2].message, QByteArray("\xc3\xa4"));
+    }
+
+    void testWrapAround()
+    {
+        RingBufferTracer tracer(QString(), 4096);
+        for (int i = 0; i < 1000; ++i) {
+            tracer.connectionOutput(QLatin1String("0x1"), QByteArray::number(i) + " OK");
+        }
+
+        const QList<Record> records = parseRecords(tracer.records());
+        QVERIFY(records.count() > 0);
+        QVERIFY(records.count() < 1000);
+        // the most recent records are kept, in order
+        const int first = 1000 - records.count();
+        for (int i = 0; i < records.count(); ++i) {
+            QCOMPARE(records[i].message, QByteArray::number(first + i) + " OK");
+        }
+    }
+
+    void testTruncation()
+    {
+        RingBufferTracer tracer(QString(), 4096);
+        tracer.connectionOutput(QLatin1String("0x1"), "small");
+        tracer.connectionOutput(QLatin1String("0x1"), QByteArray(10000, 'x'));
+
+        // the oversized message replaces everything and is truncated to the buffer size
+        const QByteArray data = tracer.records();
+        QCOMPARE(data.size(), 4096);
+        const QList<Record> records = parseRecords(data);
+        QCOMPARE(records.count(), 1);
+        QCOMPARE(records[0].message, QByteArray(4096 - 15 - 3, 'x'));
+    }
+
+    void testDump()
+    {
+        QTemporaryFile tmp;
+        QVERIFY(tmp.open());
+        const QString fileName = tmp.fileName();
+        tmp.close();
+
+        RingBufferTracer tracer(fileName, 4096);
+        tracer.connectionInput(QLatin1String("0x1"), "1 LOGIN foo");
+        tracer.dump();
+
+        QFile file(fileName);
+        QVERIFY(file.open(QIODevice::ReadOnly));
+        const QByteArray data = file.readAll();
+        file.close();
+        QVERIFY(data.startsWith("AKTRACE1"));
+        QCOMPARE(data.mid(8), tracer.records());
+
+        // dumping again replaces the file and keeps the older records
+        tracer.connectionOutput(QLatin1String("0x1"), "1 OK");
+        tracer.dump();
+        QVERIFY(file.open(QIODevice::ReadOnly));
+        const QList<Record> records = parseRecords(file.readAll().mid(8));
+        QCOMPARE(records.count(), 2);
+        QCOMPARE(records[0].message, QByteArray("1 LOGIN foo"));
+        QCOMPARE(records[1].message, QByteArray("1 OK"));
+    }
+};
+
+AKTEST_MAIN(RingBufferTracerTest)
+
+#include "ringbuffertracertest.moc"